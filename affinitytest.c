@@ -0,0 +1,83 @@
+//
+// CPU affinity: masks are checked and inherited, and processes pinned
+// to CPU 0 are only ever seen running there.
+//
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "stateinfo.h"
+
+#define NSPIN 3
+#define NSAMPLES 50
+
+int main(int argc, char **argv) {
+  struct procinfo *pi_arr = malloc(NPROC * sizeof(struct procinfo));
+  struct cpuinfo *cpui_arr = malloc(NCPU * sizeof(struct cpuinfo));
+  int ncpu, i, j, k, fail = 0, seen = 0;
+  int spin[NSPIN], fd[2];
+  uint all, mask;
+
+  if ((ncpu = state(&pi_arr, &cpui_arr)) < 0) {
+    printf(STDOUT, "affinitytest: state FAILED\n");
+    exit();
+  }
+  all = (1 << ncpu) - 1;
+  if (sched_getaffinity(0, &mask) < 0 || mask != all) {
+    printf(STDOUT, "affinitytest: default mask %x FAILED\n", mask);
+    fail = 1;
+  }
+  if (sched_setaffinity(0, 0) != -1 || sched_setaffinity(0, ~all) != -1 ||
+      sched_setaffinity(-1, all) != -1) {
+    printf(STDOUT, "affinitytest: bad mask accepted FAILED\n");
+    fail = 1;
+  }
+
+  // The parent keeps to the last CPU, children inherit it.
+  sched_setaffinity(0, 1 << (ncpu - 1));
+  pipe(fd);
+  if (fork() == 0) {
+    sched_getaffinity(0, &mask);
+    write(fd[1], &mask, sizeof(mask));
+    exit();
+  }
+  read(fd[0], &mask, sizeof(mask));
+  wait();
+  close(fd[0]);
+  close(fd[1]);
+  if (mask != 1 << (ncpu - 1)) {
+    printf(STDOUT, "affinitytest: inherited mask %x FAILED\n", mask);
+    fail = 1;
+  }
+
+  for (i = 0; i < NSPIN; ++i) {
+    if ((spin[i] = fork()) == 0) {
+      sched_setaffinity(0, 1);
+      for (;;)
+        ;
+    }
+  }
+  for (k = 0; k < NSAMPLES; ++k) {
+    sleep(1);
+    state(&pi_arr, &cpui_arr);
+    for (i = 1; i < ncpu; ++i)
+      for (j = 0; j < NSPIN; ++j)
+        if (cpui_arr[i].pid == spin[j]) {
+          printf(STDOUT, "affinitytest: pid %d on cpu %d FAILED\n", spin[j], i);
+          fail = 1;
+        }
+    for (j = 0; j < NSPIN; ++j)
+      seen += cpui_arr[0].pid == spin[j];
+  }
+  for (i = 0; i < NSPIN; ++i)
+    kill(spin[i]);
+  for (i = 0; i < NSPIN; ++i)
+    wait();
+  if (seen == 0) {
+    printf(STDOUT, "affinitytest: pinned processes never ran FAILED\n");
+    fail = 1;
+  }
+  sched_setaffinity(0, all);
+
+  printf(STDOUT, fail ? "affinitytest: FAILED\n" : "affinitytest OK\n");
+  exit();
+}
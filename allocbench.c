@@ -0,0 +1,108 @@
+//
+// Block allocation latency as the disk fills: writes files until the
+// disk is full, reporting the time per block written at every tenth
+// of the space that was free at the start. Then removes every other
+// file and fills the holes the same way, the worst case for a search
+// of the bitmap that starts over at its first block.
+// usage: allocbench [KB per file]
+//
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "date.h"
+#include "bcache.h"
+
+#define MAXFILES 512
+
+static char buf[4096];
+
+static uint
+nfree(void) {
+  struct bcachestat st;
+
+  bcachestat(&st);
+  return st.nfree;
+}
+
+// Write files[n] for every n with files[n] == 0, kb each, until the
+// disk is full, reporting each tenth of free0 blocks allocated.
+static void
+fill(char *label, char *files, int nfiles, int kb, uint free0) {
+  struct timespec t0, t1;
+  char path[16];
+  uint blocks = 0, step = 1, left;
+  int n, fd, i, r;
+
+  printf(STDOUT, "%s\n", label);
+  monotime(&t0);
+  for (n = 0; n < nfiles; n++) {
+    if (files[n])
+      continue;
+    benchname(path, "ab", n, -1);
+    if ((fd = open(path, O_CREATE | O_RDWR)) < 0) {
+      printf(STDERR, "allocbench: cannot create %s\n", path);
+      exit();
+    }
+    files[n] = 1;
+    for (i = 0; i < kb / 4; i++) {
+      r = write(fd, buf, sizeof(buf));
+      if (r > 0)
+        blocks++;
+      if (r != sizeof(buf)) {
+        close(fd);
+        goto full;
+      }
+      left = nfree();
+      if (step < 10 && left * 10 <= free0 * (10 - step)) {
+        monotime(&t1);
+        printf(STDOUT, "  %d%% used: %d us per block\n", step * 10,
+               blocks ? elapsedus(&t0, &t1) / blocks : 0);
+        step++;
+        blocks = 0;
+        t0 = t1;
+      }
+    }
+    close(fd);
+  }
+full:
+  monotime(&t1);
+  printf(STDOUT, "  full: %d us per block, %d blocks free\n",
+         blocks ? elapsedus(&t0, &t1) / blocks : 0, nfree());
+}
+
+int main(int argc, char **argv) {
+  static char files[MAXFILES];
+  char path[16];
+  uint free0;
+  int kb, n;
+
+  kb = argc > 1 ? atoi(argv[1]) : 256;
+  if (kb < 4) {
+    printf(STDERR, "usage: allocbench [KB per file]\n");
+    exit();
+  }
+  memset(buf, 'a', sizeof(buf));
+
+  free0 = nfree();
+  printf(STDOUT, "allocbench: %d KB files, %d blocks free\n", kb, free0);
+  fill("filling:", files, MAXFILES, kb, free0);
+
+  for (n = 0; n < MAXFILES; n += 2) {
+    if (files[n]) {
+      benchname(path, "ab", n, -1);
+      unlink(path);
+      files[n] = 0;
+    }
+  }
+  sync();
+  fill("refilling every other file:", files, MAXFILES, kb, nfree());
+
+  for (n = 0; n < MAXFILES; n++) {
+    if (files[n]) {
+      benchname(path, "ab", n, -1);
+      unlink(path);
+    }
+  }
+  exit();
+}
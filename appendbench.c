@@ -0,0 +1,90 @@
+//
+// Files appended to a little at a time, side by side, the way logs
+// grow: one process keeps several files open and appends a small
+// record to each in turn. Compares per-block addresses (O_BLOCKMAP)
+// with extents and their preallocation windows. Reports the contiguous
+// runs per file, the blocks written to disk while appending, log
+// included, and how fast the files read back from the disk.
+// usage: appendbench [files] [KB] [record]
+//
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "date.h"
+#include "bcache.h"
+
+#define MAXFILES 8
+
+static char buf[4096];
+
+static void
+run(char *label, int nfiles, int kb, int record, int mode) {
+  struct bcachestat before, after;
+  struct timespec t0, t1;
+  char path[8];
+  int fd[MAXFILES], n, i;
+  uint t = 0, runs = 0, writes, rate;
+
+  for (n = 0; n < nfiles; ++n) {
+    benchname(path, "ap", n, -1);
+    if ((fd[n] = open(path, O_CREATE | O_RDWR | mode)) < 0) {
+      printf(STDERR, "appendbench: cannot create %s\n", path);
+      exit();
+    }
+  }
+  sync();
+  bcachestat(&before);
+  for (i = 0; i < kb * 1024 / record; ++i) {
+    for (n = 0; n < nfiles; ++n) {
+      if (write(fd[n], buf, record) != record) {
+        printf(STDERR, "appendbench: write failed\n");
+        exit();
+      }
+    }
+  }
+  for (n = 0; n < nfiles; ++n)
+    close(fd[n]);
+  sync();
+  bcachestat(&after);
+  writes = after.writes - before.writes;
+
+  for (n = 0; n < nfiles; ++n) {
+    benchname(path, "ap", n, -1);
+    if ((fd[n] = open(path, O_RDONLY)) < 0) {
+      printf(STDERR, "appendbench: cannot open %s\n", path);
+      exit();
+    }
+    runs += fruns(fd[n]);
+    fadvise(fd[n], FADV_DONTNEED);
+    monotime(&t0);
+    while (read(fd[n], buf, sizeof(buf)) > 0)
+      ;
+    monotime(&t1);
+    t += elapsedms(&t0, &t1);
+    close(fd[n]);
+    unlink(path);
+  }
+
+  rate = t ? nfiles * kb * 1000 / t : 0;
+  printf(STDOUT, "%s %d runs per file, %d blocks written, read %d.%d MB/s\n",
+         label, runs / nfiles, writes, rate / 1024, rate % 1024 * 10 / 1024);
+}
+
+int main(int argc, char **argv) {
+  int nfiles, kb, record;
+
+  nfiles = argc > 1 ? atoi(argv[1]) : 4;
+  kb = argc > 2 ? atoi(argv[2]) : 512;
+  record = argc > 3 ? atoi(argv[3]) : 256;
+  if (nfiles < 1 || nfiles > MAXFILES || kb < 4 || record < 1 || record > sizeof(buf)) {
+    printf(STDERR, "usage: appendbench [files] [KB] [record]\n");
+    exit();
+  }
+  memset(buf, 'a', sizeof(buf));
+
+  printf(STDOUT, "appendbench: %d files x %d KB in %d-byte records\n", nfiles, kb, record);
+  run("block map:", nfiles, kb, record, O_BLOCKMAP);
+  run("extents:  ", nfiles, kb, record, 0);
+  exit();
+}
@@ -0,0 +1,17 @@
+#ifndef XV6_PUBLIC_BCACHE_H
+#define XV6_PUBLIC_BCACHE_H
+
+// Buffer cache counters, returned by bcachestat().
+struct bcachestat {
+  uint nbuf;        // buffers allocated so far
+  uint max;         // buffers the cache may grow to (NBUF)
+  uint hits;        // bread()s of a cached block
+  uint misses;      // bread()s that needed a buffer for the block
+  uint evictions;   // cached blocks dropped to make room
+  uint readahead;   // blocks read by breadahead()
+  uint writes;      // blocks written to disk, log included
+  uint requests;    // disk commands, each for a run of blocks
+  uint nfree;       // free blocks in the root file system
+};
+
+#endif //XV6_PUBLIC_BCACHE_H
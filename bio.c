@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -13,46 +13,147 @@
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
 //
-// The implementation uses two state flags internally:
+// The implementation uses three state flags internally:
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+// * B_ASYNC: breadahead() or bawrite() started a disk transfer
+//     nobody waits for; the buffer stays locked until the disk
+//     interrupt hands it back with bdone().
+//
+// Buffers hash on (dev, blockno) into NBUCKET chains, each with its
+// own lock, so lookups of different blocks do not contend. The cache
+// starts empty and grows a page of buffers at a time, from kalloc(),
+// up to NBUF buffers; after that a miss recycles a buffer chosen by
+// CLOCK: the hand sweeps the ring of all buffers, clearing reference
+// bits, and takes the first idle buffer whose bit is already clear.
+//
+// Lock order: bcache.lock, then bucket locks. Only a miss takes
+// bcache.lock, and only while holding it may a second bucket lock be
+// taken, so misses are serialized but hits and brelse() never wait
+// for them except on their own bucket.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "bcache.h"
 
-struct {
-  struct spinlock lock;
-  struct buf buf[NBUF];
+#define NBUCKET 251              // prime, so blocks with a stride still spread
+#define BPERPAGE (PGSIZE / BSIZE)
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+struct bucket {
+  struct spinlock lock;          // protects the chain and its bufs' refcnt, used
+  struct buf *head;              // chain through hnext
+  uint hits;
+  uint readahead;
+  uint writes;
+};
+
+struct {
+  struct spinlock lock;          // serializes misses; protects the fields below
+  struct buf *hand;              // CLOCK hand on the ring through next
+  struct buf *free;              // grown but never used, through hnext
+  struct buf *hdr;               // unused headers left in the last header page
+  int nhdr;
+  struct bcachestat stat;
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+static struct bucket*
+bhash(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
 void
 binit(void)
 {
-  struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < &bcache.bucket[NBUCKET]; bk++)
+    initlock(&bk->lock, "bcache.bucket");
+  bcache.stat.max = NBUF;
+}
 
-//PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+// Add a page of buffers to the cache, on the free list and the
+// CLOCK ring. Headers are packed into pages of their own, so the
+// data stays block aligned. Caller holds bcache.lock.
+static int
+bgrow(void)
+{
+  struct buf *b;
+  char *data;
+  int i;
+
+  if(bcache.nhdr < BPERPAGE){
+    if((b = (struct buf*)kalloc()) == 0)
+      return -1;
+    memset(b, 0, PGSIZE);
+    bcache.hdr = b;
+    bcache.nhdr = PGSIZE / sizeof(struct buf);
+  }
+  if((data = kalloc()) == 0)
+    return -1;
+  for(i = 0; i < BPERPAGE; i++){
+    b = bcache.hdr++;
+    bcache.nhdr--;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->data = (uchar*)data + i*BSIZE;
+    b->hnext = bcache.free;
+    bcache.free = b;
+    if(bcache.hand){
+      b->next = bcache.hand->next;
+      bcache.hand->next = b;
+    } else {
+      b->next = b;
+      bcache.hand = b;
+    }
   }
+  bcache.stat.nbuf += BPERPAGE;
+  return 0;
+}
+
+// Find an idle buffer with CLOCK and unhash it. bk, the bucket the
+// caller is about to use, is locked already. Caller holds bcache.lock.
+static struct buf*
+bvictim(struct bucket *bk)
+{
+  struct buf *b, **pp;
+  struct bucket *vbk;
+  int n;
+
+  // Two sweeps: the first may only clear reference bits.
+  for(n = 2 * bcache.stat.nbuf; n > 0; n--){
+    b = bcache.hand;
+    bcache.hand = b->next;
+    vbk = bhash(b->dev, b->blockno);
+    if(vbk != bk)
+      acquire(&vbk->lock);
+    // Even if refcnt==0, B_DIRTY indicates a buffer is in use
+    // because log.c has modified it but not yet committed it.
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+      if(b->used)
+        b->used = 0;
+      else {
+        for(pp = &vbk->head; *pp != b; pp = &(*pp)->hnext)
+          ;
+        *pp = b->hnext;
+        if(vbk != bk)
+          release(&vbk->lock);
+        bcache.stat.evictions++;
+        return b;
+      }
+    }
+    if(vbk != bk)
+      release(&vbk->lock);
+  }
+  return 0;
 }
 
 // Look through buffer cache for block on device dev.
@@ -61,42 +162,59 @@ binit(void)
 static struct buf*
 bget(uint dev, uint blockno)
 {
+  struct bucket *bk = bhash(dev, blockno);
   struct buf *b;
+  int miss = 0;
 
-  acquire(&bcache.lock);
-
-  // Is the block already cached?
-//  cprintf("banzai 2\n");
-//  cprintf("dev: %d blockno: %d\n", dev, blockno);
-
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-//    cprintf("0x%x ", b);
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-//      cprintf("\n");
-      return b;
+  acquire(&bk->lock);
+  for(;;){
+    // Is the block already cached?
+    for(b = bk->head; b; b = b->hnext){
+      if(b->dev == dev && b->blockno == blockno){
+        b->refcnt++;
+        b->used = 1;
+        bk->hits++;
+        release(&bk->lock);
+        if(miss)
+          release(&bcache.lock);
+        acquiresleep(&b->lock);
+        return b;
+      }
     }
+    if(miss)
+      break;
+    // Not cached. Look again holding bcache.lock,
+    // in case another miss cached it meanwhile.
+    release(&bk->lock);
+    acquire(&bcache.lock);
+    acquire(&bk->lock);
+    miss = 1;
   }
-//  cprintf("\n");
-
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-
-      return b;
-    }
+
+  // Use a fresh buffer while the cache may grow, else recycle
+  // an idle one; grow past NBUF only if every buffer is busy.
+  if(bcache.free == 0 && bcache.stat.nbuf < bcache.stat.max)
+    bgrow();
+  if((b = bcache.free) != 0)
+    bcache.free = b->hnext;
+  else if((b = bvictim(bk)) == 0 && bgrow() == 0){
+    b = bcache.free;
+    bcache.free = b->hnext;
   }
-  panic("bget: no buffers");
+  if(b == 0)
+    panic("bget: no buffers");
+  b->dev = dev;
+  b->blockno = blockno;
+  b->flags = 0;
+  b->refcnt = 1;
+  b->used = 1;
+  b->hnext = bk->head;
+  bk->head = b;
+  bcache.stat.misses++;
+  release(&bk->lock);
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -106,49 +224,145 @@ bread(uint dev, uint blockno)
   struct buf *b;
 
   b = bget(dev, blockno);
-//  cprintf("banzai 2\n");
-
-
   if((b->flags & B_VALID) == 0) {
     iderw(b);
   }
   return b;
 }
 
+// Start reading the indicated block into the cache without waiting
+// for it, unless it is cached or on its way already.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct bucket *bk = bhash(dev, blockno);
+  struct buf *b;
+
+  acquire(&bk->lock);
+  for(b = bk->head; b; b = b->hnext)
+    if(b->dev == dev && b->blockno == blockno)
+      break;
+  release(&bk->lock);
+  if(b)
+    return;
+
+  b = bget(dev, blockno);
+  if(b->flags & B_VALID){  // someone else read it meanwhile
+    brelse(b);
+    return;
+  }
+  acquire(&bk->lock);
+  bk->readahead++;
+  release(&bk->lock);
+  b->flags |= B_ASYNC;
+  iderw(b);
+}
+
+// The transfer started by breadahead() or bawrite() finished: release
+// b on behalf of the process that started it. Called by the disk driver.
+void
+bdone(struct buf *b)
+{
+  struct bucket *bk = bhash(b->dev, b->blockno);
+
+  b->flags &= ~B_ASYNC;
+  releasesleep(&b->lock);
+  acquire(&bk->lock);
+  b->refcnt--;
+  release(&bk->lock);
+}
+
+// Drop the indicated block from the cache if it is cached, idle and
+// clean, so that the next bread() goes to the disk.
+void
+binval(uint dev, uint blockno)
+{
+  struct bucket *bk = bhash(dev, blockno);
+  struct buf *b, **pp;
+
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  for(pp = &bk->head; (b = *pp) != 0; pp = &b->hnext){
+    if(b->dev == dev && b->blockno == blockno){
+      if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+        *pp = b->hnext;
+        b->hnext = bcache.free;
+        bcache.free = b;
+      }
+      break;
+    }
+  }
+  release(&bk->lock);
+  release(&bcache.lock);
+}
+
+static void
+bcountwrite(struct buf *b)
+{
+  struct bucket *bk = bhash(b->dev, b->blockno);
+
+  acquire(&bk->lock);
+  bk->writes++;
+  release(&bk->lock);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
+  bcountwrite(b);
   b->flags |= B_DIRTY;
   iderw(b);
 }
 
-// Release a locked buffer.
-// Move to the head of the MRU list.
+// Start writing b's contents to disk and release b without waiting:
+// the disk driver does when the write is done. Must be locked.
+void
+bawrite(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bawrite");
+  bcountwrite(b);
+  b->flags |= B_DIRTY | B_ASYNC;
+  iderw(b);
+}
+
+// Release a locked buffer. It stays cached, with its
+// reference bit set, until CLOCK finds it idle twice.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
+  release(&bk->lock);
+}
+
+// Copy the cache counters.
+void
+bstat(struct bcachestat *st)
+{
+  struct bucket *bk;
+
+  acquire(&bcache.lock);
+  *st = bcache.stat;
   release(&bcache.lock);
+  for(bk = bcache.bucket; bk < &bcache.bucket[NBUCKET]; bk++){
+    st->hits += bk->hits;
+    st->readahead += bk->readahead;
+    st->writes += bk->writes;
+  }
+  st->requests = iderequests();
+  st->nfree = bfreecount();
 }
 //PAGEBREAK!
 // Blank page.
-
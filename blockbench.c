@@ -0,0 +1,119 @@
+//
+// Throughput of the block layer: sequential write and read of a file
+// and swapping a range of pages out and back in. Reports the disk
+// requests each took, so runs on file systems of different block
+// sizes can be compared.
+// usage: blockbench [KB] [pages]
+//
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+#include "mmu.h"
+#include "mman.h"
+#include "date.h"
+#include "bcache.h"
+
+#define FILE "blockbench.tmp"
+
+static char buf[4096];
+
+static void
+report(char *label, uint kb, uint t, uint requests) {
+  uint rate = t ? kb * 1000 / t : 0;
+
+  printf(STDOUT, "%s %d.%d MB/s, %d disk requests\n", label,
+         rate / 1024, rate % 1024 * 10 / 1024, requests);
+}
+
+static void
+files(uint kb) {
+  struct bcachestat before, after;
+  struct timespec t0, t1;
+  int fd, n;
+  uint i;
+
+  if ((fd = open(FILE, O_CREATE | O_RDWR)) < 0) {
+    printf(STDERR, "blockbench: cannot create %s\n", FILE);
+    exit();
+  }
+  sync();
+  bcachestat(&before);
+  monotime(&t0);
+  for (i = 0; i < kb / 4; ++i) {
+    if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+      printf(STDERR, "blockbench: write failed\n");
+      exit();
+    }
+  }
+  sync();
+  monotime(&t1);
+  bcachestat(&after);
+  close(fd);
+  report("write:   ", kb, elapsedms(&t0, &t1), after.writes - before.writes);
+
+  if ((fd = open(FILE, O_RDONLY)) < 0) {
+    printf(STDERR, "blockbench: cannot open %s\n", FILE);
+    exit();
+  }
+  fadvise(fd, FADV_DONTNEED);
+  bcachestat(&before);
+  monotime(&t0);
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    ;
+  monotime(&t1);
+  bcachestat(&after);
+  close(fd);
+  unlink(FILE);
+  report("read:    ", kb, elapsedms(&t0, &t1), after.misses - before.misses);
+}
+
+static void
+pages(int npages) {
+  struct bcachestat before, mid, after;
+  struct timespec t0, t1, t2;
+  char *mem;
+  int i;
+
+  if ((mem = sbrk(npages * PGSIZE)) == (char *) -1) {
+    printf(STDERR, "blockbench: sbrk failed\n");
+    exit();
+  }
+  for (i = 0; i < npages; ++i)
+    mem[i * PGSIZE] = i;
+  // SEQUENTIAL pages go on the first swap().
+  madvise(mem, npages * PGSIZE, MADV_SEQUENTIAL);
+  bcachestat(&before);
+  monotime(&t0);
+  swap();
+  monotime(&t1);
+  bcachestat(&mid);
+  for (i = 0; i < npages; ++i) {
+    if (mem[i * PGSIZE] != (char) i) {
+      printf(STDERR, "blockbench: swapped page %d lost\n", i);
+      exit();
+    }
+  }
+  monotime(&t2);
+  bcachestat(&after);
+  report("swap out:", npages * PGSIZE / 1024, elapsedms(&t0, &t1), mid.writes - before.writes);
+  report("swap in: ", npages * PGSIZE / 1024, elapsedms(&t1, &t2), after.misses - mid.misses);
+}
+
+int main(int argc, char **argv) {
+  int kb, npages;
+
+  kb = argc > 1 ? atoi(argv[1]) : 2048;
+  npages = argc > 2 ? atoi(argv[2]) : 64;
+  if (kb < 4 || npages < 1) {
+    printf(STDERR, "usage: blockbench [KB] [pages]\n");
+    exit();
+  }
+  memset(buf, 'b', sizeof(buf));
+
+  printf(STDOUT, "blockbench: %d-byte blocks, %d KB file, %d pages\n", BSIZE, kb, npages);
+  files(kb);
+  pages(npages);
+  exit();
+}
@@ -4,11 +4,13 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  int used;          // CLOCK reference bit
+  struct buf *hnext; // hash bucket chain, or free list
+  struct buf *next;  // CLOCK ring
   struct buf *qnext; // disk queue
-  uchar data[BSIZE];
+  uchar *data;       // BSIZE bytes in a page of the cache
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // nobody waits: the disk driver releases the buffer
 
@@ -0,0 +1,84 @@
+//
+// Parallel file creation: every process creates its own files, then
+// removes them. Run once leaving commits to logd and once with fsync()
+// after every create, as when each end_op() committed. Reports creates
+// per second and disk blocks written per create, sync() included.
+// usage: createbench [procs] [files]
+//
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "date.h"
+#include "bcache.h"
+
+#define MAXPROCS 8
+
+static void
+creates(int p, int nfiles, int eager) {
+  char path[16];
+  int fd, i;
+
+  for (i = 0; i < nfiles; ++i) {
+    benchname(path, "cb", p, i);
+    if ((fd = open(path, O_CREATE | O_RDWR)) < 0) {
+      printf(STDERR, "createbench: cannot create %s\n", path);
+      exit();
+    }
+    if (eager)
+      fsync(fd);
+    close(fd);
+  }
+}
+
+static void
+run(char *label, int nprocs, int nfiles, int eager) {
+  struct bcachestat before, after;
+  struct timespec t0, t1;
+  char path[16];
+  uint t, writes, n = nprocs * nfiles;
+  int p, i;
+
+  sync();
+  bcachestat(&before);
+  monotime(&t0);
+  for (p = 0; p < nprocs; ++p) {
+    if (fork() == 0) {
+      creates(p, nfiles, eager);
+      exit();
+    }
+  }
+  for (p = 0; p < nprocs; ++p)
+    wait();
+  sync();
+  monotime(&t1);
+  bcachestat(&after);
+
+  for (p = 0; p < nprocs; ++p) {
+    for (i = 0; i < nfiles; ++i) {
+      benchname(path, "cb", p, i);
+      unlink(path);
+    }
+  }
+
+  t = elapsedms(&t0, &t1);
+  writes = after.writes - before.writes;
+  printf(STDOUT, "%s %d creates/s, %d blocks written, %d.%d per create\n", label,
+         t ? n * 1000 / t : 0, writes, writes / n, writes * 10 / n % 10);
+}
+
+int main(int argc, char **argv) {
+  int nprocs, nfiles;
+
+  nprocs = argc > 1 ? atoi(argv[1]) : 8;
+  nfiles = argc > 2 ? atoi(argv[2]) : 20;
+  if (nprocs < 1 || nprocs > MAXPROCS || nfiles < 1) {
+    printf(STDERR, "usage: createbench [procs] [files]\n");
+    exit();
+  }
+
+  printf(STDOUT, "createbench: %d procs x %d files\n", nprocs, nfiles);
+  run("group commit:", nprocs, nfiles, 0);
+  run("fsync each:  ", nprocs, nfiles, 1);
+  exit();
+}
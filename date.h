@@ -6,3 +6,9 @@ struct rtcdate {
   uint month;
   uint year;
 };
+
+// nanosleep() and monotime() intervals.
+struct timespec {
+  uint tv_sec;
+  uint tv_nsec;  // below 1000000000
+};
@@ -13,12 +13,23 @@ struct superblock;
 struct cpuinfo;
 struct procinfo;
 struct stateinfo;
+struct ksmstat;
+struct bcachestat;
+struct wssinfo;
+struct timer;
+struct timespec;
+struct schedhist;
 
 #define  DEFS_HEADER
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
+void            bstat(struct bcachestat*);
+void            breadahead(uint, uint);
+void            bawrite(struct buf*);
+void            bdone(struct buf*);
+void            binval(uint, uint);
 void            bwrite(struct buf*);
 
 // console.c
@@ -44,9 +55,13 @@ int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
 int             fileseek(struct file *f, off_t offset, int whence);
 int             filetruncate(struct file *f, off_t length);
+int             fileadvise(struct file*, int);
+int             fileruns(struct file*);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
+void            bsuminit(int dev);
+uint            bfreecount(void);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
@@ -61,18 +76,29 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+void            readahead(struct inode*, uint, uint);
+void            iuncache(struct inode*);
+uint            iruns(struct inode*);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
+int             writeblocks(uint, uint);
+int             putblocks(void);
 void            swapinit(void);
 void            swapwrite(const char *buf, void *va);
 void *          swapread(void *va, uint pa);
 //int             swaprestore(void *va, pte_t *pte, pde_t *pgdir);
 
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint, uint);
+int             futexwake(uint, int);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+uint            iderequests(void);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -100,13 +126,18 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(int, int);
+uint            lapiccount(void);
+void            lapiconeshot(uint);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
-void            begin_op();
+void            logcommit(void);
+void            logflush(void);
+void            begin_op(int);
 void            end_op();
 
 // mp.c
@@ -141,8 +172,34 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupn(void*, int);
+int             schedstat(int, struct schedhist*);
 void            yield(void);
 int             procdumpWrite(struct procinfo *pi_arr, struct cpuinfo *cpui_arr);
+struct proc*    kthread_create(char*, void (*)(void));
+int             setpriority(int, int);
+int             setclass(int, int);
+int             getpriority(int, int*);
+int             setaffinity(int, uint);
+int             clone(void (*)(void*), void*, void*);
+int             join(void**);
+int             setpgdir(struct proc*, pde_t*);
+int             vmrunning(pde_t*);
+void            tlbshootdown(pde_t*);
+void            tlbflushed(void);
+int             vmshared(struct proc*);
+int             getaffinity(int, uint*);
+int             setgang(int, int);
+
+// ksm.c
+void            ksmd(void);
+void            ksmgetstat(struct ksmstat*);
+
+// kidle.c
+extern uint     idlepass;
+void            kidled(void);
+int             setidleinterval(int);
+int             wssget(int, struct wssinfo*);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -180,7 +237,18 @@ int             fetchstr(uint, char**);
 void            syscall(void);
 
 // timer.c
+void            monotime(struct timespec*);
+uint            tickupdate(void);
+int             ticksleep(uint);
+void            timeradd(struct timer*);
+void            timerdel(struct timer*);
 void            timerinit(void);
+int             timerintr(void);
+int             timersleep(uint64);
+void            timertick(void);
+uint64          timespec2tsc(struct timespec*);
+void            tsc2timespec(uint64, struct timespec*);
+uint            tsckhz(void);
 
 // trap.c
 void            idtinit(void);
@@ -195,11 +263,13 @@ void            uartputc(int);
 
 // vm.c
 void            seginit(void);
+uint*           walkpgdir(pde_t*, const void*, BOOL);
 void            kvmalloc(void);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
+void            unmapuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
@@ -212,6 +282,18 @@ int             swap();
 //int             lazyalloc(uint addr);
 //int             copy_on_write(void    *va, pte_t *pte, struct proc *p);
 int             handle_pagefault(uint addr, uint err);
+int             faultin(uint);
+struct sleeplock* vmbegin(struct proc*);
+void            vmend(struct sleeplock*);
+int             madvise(struct proc*, uint, uint, int);
+BOOL            pte_young(uint*);
+int             madvice_of(struct proc*, uint);
+void            countuvm(pde_t*, uint, uint*, uint*, uint*);
+int             mlock(struct proc*, uint, uint);
+int             munlock(struct proc*, uint, uint);
+int             mlockall(struct proc*, int);
+int             munlockall(struct proc*);
+void            mlocksync(struct proc*);
 
 void
 flush_tlb(void);
@@ -11,7 +11,7 @@ int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, shared;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
@@ -19,7 +19,7 @@ exec(char *path, char **argv)
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
 
-  begin_op();
+  begin_op(putblocks());
 
   if((ip = namei(path)) == 0){
     end_op();
@@ -95,12 +95,18 @@ exec(char *path, char **argv)
 
   // Commit to the user image.
   oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
+  shared = setpgdir(curproc, pgdir);
   curproc->sz = sz;
+  memset(curproc->advice, 0, sizeof(curproc->advice));
+  curproc->nlocked = 0;
+  curproc->mlockflags = 0;
+  memset(curproc->wss, 0, sizeof(curproc->wss));
+  curproc->wsssamples = 0;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
-  freevm(oldpgdir);
+  if(!shared)  // other threads keep running in it
+    freevm(oldpgdir);
   return 0;
 
  bad:
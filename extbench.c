@@ -0,0 +1,98 @@
+//
+// Fragmentation and sequential read throughput of files written side
+// by side, with per-block addresses (O_BLOCKMAP) and with extents.
+// Several processes append to their own files at once, so that their
+// allocations interleave; then each file is read back from the disk.
+// Reports the contiguous runs per file and the disk commands the
+// reads took.
+// usage: extbench [procs] [KB]
+//
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "date.h"
+#include "bcache.h"
+
+#define MAXPROCS 8
+
+static char buf[4096];
+
+static void
+append(int p, int kb, int mode) {
+  char path[8];
+  int fd, i;
+
+  benchname(path, "eb", p, -1);
+  if ((fd = open(path, O_CREATE | O_RDWR | mode)) < 0) {
+    printf(STDERR, "extbench: cannot create %s\n", path);
+    exit();
+  }
+  for (i = 0; i < kb / 4; ++i) {
+    if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+      printf(STDERR, "extbench: write failed\n");
+      exit();
+    }
+  }
+  close(fd);
+}
+
+static void
+run(char *label, int nprocs, int kb, int mode) {
+  struct bcachestat before, after;
+  struct timespec t0, t1;
+  char path[8];
+  uint t = 0, runs = 0, rate;
+  int p, fd;
+
+  for (p = 0; p < nprocs; ++p) {
+    if (fork() == 0) {
+      append(p, kb, mode);
+      exit();
+    }
+  }
+  for (p = 0; p < nprocs; ++p)
+    wait();
+  sync();
+
+  bcachestat(&before);
+  for (p = 0; p < nprocs; ++p) {
+    benchname(path, "eb", p, -1);
+    if ((fd = open(path, O_RDONLY)) < 0) {
+      printf(STDERR, "extbench: cannot open %s\n", path);
+      exit();
+    }
+    runs += fruns(fd);
+    fadvise(fd, FADV_DONTNEED);
+    monotime(&t0);
+    while (read(fd, buf, sizeof(buf)) > 0)
+      ;
+    monotime(&t1);
+    t += elapsedms(&t0, &t1);
+    close(fd);
+    unlink(path);
+  }
+  bcachestat(&after);
+
+  rate = t ? nprocs * kb * 1000 / t : 0;
+  printf(STDOUT, "%s %d runs per file, read %d.%d MB/s in %d disk commands\n",
+         label, runs / nprocs, rate / 1024, rate % 1024 * 10 / 1024,
+         after.requests - before.requests);
+}
+
+int main(int argc, char **argv) {
+  int nprocs, kb;
+
+  nprocs = argc > 1 ? atoi(argv[1]) : 4;
+  kb = argc > 2 ? atoi(argv[2]) : 1024;
+  if (nprocs < 1 || nprocs > MAXPROCS || kb < 4) {
+    printf(STDERR, "usage: extbench [procs] [KB]\n");
+    exit();
+  }
+  memset(buf, 'e', sizeof(buf));
+
+  printf(STDOUT, "extbench: %d procs x %d KB\n", nprocs, kb);
+  run("block map:", nprocs, kb, O_BLOCKMAP);
+  run("extents:  ", nprocs, kb, 0);
+  exit();
+}
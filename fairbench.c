@@ -0,0 +1,78 @@
+//
+// CPU share of SCHED_FAIR processes with different nice values.
+// usage: fairbench [ticks] [nice ...]
+// Shares are only comparable to the weights when the processes share
+// one CPU (make qemu CPUS=1).
+//
+#include "types.h"
+#include "user.h"
+#include "param.h"
+
+#define MAXPROCS 8
+
+// Weights of nice -20..19, as in the kernel's vruntime scaling.
+static const uint weights[NPRIO] = {
+  88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+  9548, 7620, 6100, 4904, 3906, 3121, 2501, 1991, 1586, 1277,
+  1024, 820, 655, 526, 423, 335, 272, 215, 172, 137,
+  110, 87, 70, 56, 45, 36, 29, 23, 18, 15,
+};
+
+static void
+work(int until, int fd) {
+  volatile uint x = 0;
+  uint loops = 0;
+
+  while (uptime() < until) {
+    for (int i = 0; i < 1000; ++i)
+      x += i;
+    loops++;
+  }
+  write(fd, &loops, sizeof(loops));
+  exit();
+}
+
+int main(int argc, char **argv) {
+  int nices[MAXPROCS] = {0, 5, 10};
+  int n = 3, duration = 500, i, start;
+  uint loops[MAXPROCS], total = 0, wsum = 0;
+  int fds[MAXPROCS][2];
+
+  if (argc > 1)
+    duration = atoi(argv[1]);
+  if (argc > 2) {
+    for (n = 0; n + 2 < argc && n < MAXPROCS; ++n)
+      nices[n] = atoi(argv[n + 2]);
+  }
+
+  start = uptime() + 5; // start together once everybody is forked
+  for (i = 0; i < n; ++i) {
+    pipe(fds[i]);
+    if (fork() == 0) {
+      setpriority(0, nices[i]);
+      while (uptime() < start)
+        ;
+      work(start + duration, fds[i][1]);
+    }
+  }
+  for (i = 0; i < n; ++i) {
+    read(fds[i][0], &loops[i], sizeof(loops[i]));
+    wait();
+    total += loops[i];
+    if (nices[i] < PRIO_MIN)
+      nices[i] = PRIO_MIN;
+    if (nices[i] > PRIO_MAX)
+      nices[i] = PRIO_MAX;
+    wsum += weights[nices[i] - PRIO_MIN];
+  }
+
+  printf(STDOUT, "fairbench: %d procs for %d ticks\n", n, duration);
+  for (i = 0; i < n; ++i) {
+    uint w = weights[nices[i] - PRIO_MIN];
+    printf(STDOUT, "nice %d\tweight %d\tloops %u\tshare %u.%u%%\texpected %u.%u%%\n",
+           nices[i], w, loops[i],
+           loops[i] * 1000 / total / 10, loops[i] * 1000 / total % 10,
+           w * 1000 / wsum / 10, w * 1000 / wsum % 10);
+  }
+  exit();
+}
@@ -2,3 +2,10 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+#define O_BLOCKMAP 0x400  // create with per-block addresses, not extents
+
+// fadvise() hints
+#define FADV_NORMAL     0   // adaptive sequential read-ahead
+#define FADV_RANDOM     1   // no read-ahead
+#define FADV_SEQUENTIAL 2   // read ahead the widest window from the start
+#define FADV_DONTNEED   3   // drop the file's idle blocks from the cache
@@ -9,6 +9,7 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -30,6 +31,8 @@ filealloc(void) {
   for (f = ftable.file; f < ftable.file + NFILE; f++) {
     if (f->ref == 0) {
       f->ref = 1;
+      f->raoff = f->rawin = f->raend = 0;
+      f->advice = FADV_NORMAL;
       release(&ftable.lock);
       return f;
     }
@@ -69,7 +72,7 @@ fileclose(struct file *f) {
   if (ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
   else if (ff.type == FD_INODE) {
-    begin_op();
+    begin_op(putblocks());
     iput(ff.ip);
     end_op();
   }
@@ -87,6 +90,69 @@ filestat(struct file *f, struct stat *st) {
   return -1;
 }
 
+// Count the contiguous runs of disk blocks holding f's data.
+int
+fileruns(struct file *f) {
+  int runs;
+
+  if (f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  runs = iruns(f->ip);
+  iunlock(f->ip);
+  return runs;
+}
+
+// Apply an fadvise() hint to file f.
+int
+fileadvise(struct file *f, int advice) {
+  if (f->type != FD_INODE)
+    return -1;
+  switch (advice) {
+    case FADV_NORMAL:
+    case FADV_RANDOM:
+    case FADV_SEQUENTIAL:
+      ilock(f->ip);
+      f->advice = advice;
+      iunlock(f->ip);
+      return 0;
+    case FADV_DONTNEED:
+      ilock(f->ip);
+      iuncache(f->ip);
+      f->raend = 0;
+      iunlock(f->ip);
+      return 0;
+  }
+  return -1;
+}
+
+// Sequential read-ahead. A read that starts where the last one ended
+// widens f's window, doubling it up to RAMAXBLOCKS, and the blocks in
+// the window past the read are queued; any other read closes it.
+// Caller holds f->ip->lock.
+static void
+filereadahead(struct file *f, uint off, int n) {
+  uint next, end;
+
+  if (off != f->raoff || f->advice == FADV_RANDOM) {
+    f->raoff = off + n;
+    f->rawin = f->raend = 0;
+    return;
+  }
+  f->raoff = off + n;
+  if (f->advice == FADV_SEQUENTIAL || f->rawin * 2 >= RAMAXBLOCKS)
+    f->rawin = RAMAXBLOCKS;
+  else
+    f->rawin = f->rawin ? f->rawin * 2 : RAMINBLOCKS;
+  next = f->raoff / BSIZE;
+  end = next + f->rawin;
+  if (next < f->raend)
+    next = f->raend;
+  if (next < end) {
+    readahead(f->ip, next, end - next);
+    f->raend = end;
+  }
+}
 
 // Read from file f.
 int
@@ -99,8 +165,10 @@ fileread(struct file *f, char *addr, int n) {
     return piperead(f->pipe, addr, n);
   if (f->type == FD_INODE) {
     ilock(f->ip);
-    if ((r = readi(f->ip, addr, f->off, n)) > 0)
+    if ((r = readi(f->ip, addr, f->off, n)) > 0) {
+      filereadahead(f, f->off, r);
       f->off += r;
+    }
     iunlock(f->ip);
     return r;
   }
@@ -118,20 +186,19 @@ filewrite(struct file *f, char *addr, int n) {
   if (f->type == FD_PIPE)
     return pipewrite(f->pipe, addr, n);
   if (f->type == FD_INODE) {
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
+    // write at most MAXWRITEBLOCKS blocks per transaction,
+    // each reserving the log blocks its share needs:
+    // see writeblocks().
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
 
-    int max = ((MAXOPBLOCKS - 1 - 1 - 2) / 2) * 512;
+    int max = MAXWRITEBLOCKS * BSIZE;
     int i = 0;
     while (i < n) {
       int n1 = n - i;
       if (n1 > max)
         n1 = max;
-      begin_op();
+      begin_op(writeblocks(f->off, n1));
       ilock(f->ip);
       if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
         f->off += r;
@@ -140,11 +207,11 @@ filewrite(struct file *f, char *addr, int n) {
 
       if (r < 0)
         break;
-      if (r != n1)
-        panic("short filewrite");
       i += r;
+      if (r != n1)
+        break;  // disk full
     }
-    return i == n ? n : -1;
+    return i > 0 || n == 0 ? i : -1;
   }
   panic("filewrite");
 }
@@ -202,7 +269,7 @@ int filetruncate(struct file *f, off_t length) {
     max = ((MAXOPBLOCKS - 1 - 1 - 2) / 2) * 512
   };
   static const char zero_array[max];
-  begin_op();
+  begin_op(0);
   ilock(f->ip);
   uint size = f->ip->size;
   iunlock(f->ip);
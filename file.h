@@ -6,6 +6,10 @@ struct file {
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  uint raoff;  // where the next read starts if it is sequential
+  uint rawin;  // read-ahead window in blocks, 0 after a seek
+  uint raend;  // blocks below this were read ahead already
+  int advice;  // FADV_* from fcntl.h
 };
 
 
@@ -22,7 +26,10 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1 /*+ 1 + 1*/];
+  uint flags;
+  uint addrs[NDIRECT+2];
+  uint pstart;        // preallocation window: reserved blocks
+  uint plen;          //   the file's next ones go to
 };
 
 // table mapping major device number to
@@ -64,29 +64,187 @@ bzero(int dev, int bno) {
 }
 
 // Blocks.
+//
+// The bitmap is summarized in memory by the free blocks in each
+// group of BPG blocks, so that allocation skips full groups without
+// looking at their bits and full bitmap blocks without reading them.
+// bsuminit() counts them at mount, after recovery; ballocrun() and
+// bfree() keep them. A group's count changes only with its bits,
+// under the bitmap block's buffer lock. Allocations without a goal
+// go next-fit, from where the last one ended.
+//
+// Blocks can also be reserved in memory, for the preallocation
+// window of a file being appended to: they stay free on disk, so
+// nothing needs undoing after a crash, but no one else allocates
+// them and the counts leave them out.
+
+#define BPG 1024                        // blocks per free-count group
+#define NGROUP ((FSSIZE + BPG - 1) / BPG)
+
+static struct {
+  uint nfree[NGROUP];                   // free, unreserved blocks per group
+  uint hint;                            // where the next goal-less search starts
+  uchar resv[(FSSIZE + 7) / 8];         // reserved blocks
+} bsum;
+
+// Is block b, of bitmap block bp, in use or reserved?
+static int
+bbusy(struct buf *bp, uint b) {
+  return (bp->data[(b % BPB) / 8] | bsum.resv[b / 8]) & (1 << (b % 8));
+}
 
-// Allocate a zeroed disk block.
-static uint
-balloc(uint dev) {
-  int b, bi, m;
+// Count the free blocks of each group.
+void
+bsuminit(int dev) {
   struct buf *bp;
+  uint b;
 
-  bp = NULL;
+  if (sb.size > FSSIZE)
+    panic("bsuminit: file system too big");
+  memset(bsum.nfree, 0, sizeof(bsum.nfree));
+  memset(bsum.resv, 0, sizeof(bsum.resv));
   for (b = 0; b < sb.size; b += BPB) {
     bp = bread(dev, BBLOCK(b, sb));
-    for (bi = 0; bi < BPB && b + bi < sb.size; bi++) {
-      m = 1 << (bi % 8);
-      if ((bp->data[bi / 8] & m) == 0) {  // Is block free?
-        bp->data[bi / 8] |= m;  // Mark block in use.
+    for (uint bi = 0; bi < BPB && b + bi < sb.size; bi++)
+      if ((bp->data[bi / 8] & (1 << (bi % 8))) == 0)
+        bsum.nfree[(b + bi) / BPG]++;
+    brelse(bp);
+  }
+  bsum.hint = 0;
+}
+
+// Free blocks in the file system, less the reserved ones.
+uint
+bfreecount(void) {
+  uint g, n = 0;
+
+  for (g = 0; g < NGROUP; g++)
+    n += bsum.nfree[g];
+  return n;
+}
+
+// Free blocks in the groups of [b, b+n).
+static uint
+bsumfree(uint b, uint n) {
+  uint g, free = 0;
+
+  for (g = b / BPG; g < (b + n + BPG - 1) / BPG && g < NGROUP; g++)
+    free += bsum.nfree[g];
+  return free;
+}
+
+// Allocate a zeroed disk block: goal if it is free, else the
+// block half way into the first run of run free blocks after it,
+// wrapping around the disk, so that whatever ends before the run
+// keeps room to grow; with no such run, the first free block.
+// Without a goal (0), start at the next-fit hint. Runs do not cross
+// bitmap blocks, and may miss runs across a group with fewer than
+// run free blocks. If ahead is set, also reserve up to *ahead free
+// blocks right after the one allocated and set *ahead to how many.
+// Return 0 if the disk is full.
+static uint
+ballocrun(uint dev, uint goal, uint run, uint *ahead) {
+  uint nbm, i, base, b, n, m, hinted, k;
+  struct buf *bp;
+
+  nbm = (sb.size + BPB - 1) / BPB;
+  hinted = goal == 0;
+  if (goal == 0 || goal >= sb.size)
+    goal = bsum.hint < sb.size ? bsum.hint : 0;
+  for (; run > 0; run = run > 1 ? 1 : 0) {
+    // The bitmap block holding goal comes first, from goal on,
+    // and last again, up to goal.
+    for (i = 0; i <= nbm; i++) {
+      base = (goal / BPB + i) % nbm * BPB;
+      if (bsumfree(base, BPB) < run)
+        continue;
+      bp = bread(dev, BBLOCK(base, sb));
+      n = 0;
+      for (b = i == 0 ? goal : base; b < base + BPB && b < sb.size; b++) {
+        if (i == nbm && b >= goal)
+          break;
+        if (b % BPG == 0 && bsum.nfree[b / BPG] < run && b != goal) {
+          b += BPG - 1;  // no run starts or ends here
+          n = 0;
+          continue;
+        }
+        if (b % 8 == 0 && (bp->data[(b % BPB) / 8] | bsum.resv[b / 8]) == 0xff &&
+            b != goal) {
+          b += 7;
+          n = 0;
+          continue;
+        }
+        if (bbusy(bp, b)) {  // Is block in use?
+          n = 0;
+          continue;
+        }
+        if (++n < run && b != goal)
+          continue;
+        if (b != goal)
+          b -= n - 1 - run / 2;
+        m = 1 << (b % 8);
+        bp->data[(b % BPB) / 8] |= m;  // Mark block in use.
+        bsum.nfree[b / BPG]--;
+        if (ahead) {
+          for (k = 0; k < *ahead && b + 1 + k < base + BPB && b + 1 + k < sb.size &&
+                      !bbusy(bp, b + 1 + k); k++) {
+            bsum.resv[(b + 1 + k) / 8] |= 1 << ((b + 1 + k) % 8);
+            bsum.nfree[(b + 1 + k) / BPG]--;
+          }
+          *ahead = k;
+        }
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+        bzero(dev, b);
+        if (hinted)
+          bsum.hint = b + 1 + (ahead ? *ahead : 0);
+        return b;
       }
+      brelse(bp);
     }
-    brelse(bp);
   }
-  panic("balloc: out of blocks");
+  return 0;
+}
+
+// Allocate a zeroed disk block, next-fit. Return 0 if the disk
+// is full.
+static uint
+balloc(uint dev) {
+  return ballocrun(dev, 0, 1, 0);
+}
+
+// Allocate reserved block b, zeroed.
+static uint
+bclaim(uint dev, uint b) {
+  struct buf *bp;
+
+  bp = bread(dev, BBLOCK(b, sb));
+  if ((bsum.resv[b / 8] & (1 << (b % 8))) == 0)
+    panic("bclaim");
+  bsum.resv[b / 8] &= ~(1 << (b % 8));
+  bp->data[(b % BPB) / 8] |= 1 << (b % 8);
+  log_write(bp);
+  brelse(bp);
+  bzero(dev, b);
+  return b;
+}
+
+// Give back what is left of ip's preallocation window.
+// Caller must hold ip->lock.
+static void
+bunreserve(struct inode *ip) {
+  struct buf *bp;
+  uint b;
+
+  if (ip->plen == 0)
+    return;
+  bp = bread(ip->dev, BBLOCK(ip->pstart, sb));  // one bitmap block holds it
+  for (b = ip->pstart; b < ip->pstart + ip->plen; b++) {
+    bsum.resv[b / 8] &= ~(1 << (b % 8));
+    bsum.nfree[b / BPG]++;
+  }
+  brelse(bp);
+  ip->plen = 0;
 }
 
 // Free a disk block.
@@ -101,6 +259,7 @@ bfree(int dev, uint b) {
   if ((bp->data[bi / 8] & m) == 0)
     panic("freeing free block");
   bp->data[bi / 8] &= ~m;
+  bsum.nfree[b / BPG]++;
   log_write(bp);
   brelse(bp);
 }
@@ -189,6 +348,8 @@ iinit(int dev) {
   }
 
   readsb(dev, &sb);
+  if (sb.bsize != BSIZE)
+    panic("iinit: file system block size is not BSIZE");
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
  inodestart %d bmap start %d swap start %d\n", sb.size, sb.nblocks,
           sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
@@ -238,6 +399,7 @@ iupdate(struct inode *ip) {
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
   dip->size = ip->size;
+  dip->flags = ip->flags;
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
   log_write(bp);
   brelse(bp);
@@ -308,6 +470,7 @@ ilock(struct inode *ip) {
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
+    ip->flags = dip->flags;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
     ip->valid = 1;
@@ -335,6 +498,13 @@ iunlock(struct inode *ip) {
 void
 iput(struct inode *ip) {
   acquiresleep(&ip->lock);
+  if (ip->plen) {
+    acquire(&icache.lock);
+    int r = ip->ref;
+    release(&icache.lock);
+    if (r == 1)
+      bunreserve(ip);  // no one is left to append
+  }
   if (ip->valid && ip->nlink == 0) {
     acquire(&icache.lock);
     int r = ip->ref;
@@ -367,17 +537,182 @@ iunlockput(struct inode *ip) {
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[IND_BLOCK], and the NDINDIRECT
+// after them in the blocks listed in block ip->addrs[DIND_BLOCK].
 
-// Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// Return entry i of indirect block addr, allocating a block
+// for it if it has none and alloc is set; 0 if the disk is full.
 static uint
-bmap(struct inode *ip, uint bn) {
-  uint addr, *a;
+bindirect(struct inode *ip, uint addr, uint i, int alloc) {
   struct buf *bp;
+  uint *a;
+
+  bp = bread(ip->dev, addr);
+  a = (uint *) bp->data;
+  if ((addr = a[i]) == NULL && alloc && (addr = balloc(ip->dev)) != 0) {
+    a[i] = addr;
+    log_write(bp);
+  }
+  brelse(bp);
+  return addr;
+}
+
+// Extents. Files only grow at their end, so a new block either
+// extends the last extent, when the disk block after it is free,
+// or starts a new extent EXTRUNBLOCKS into a free run twice that
+// long, where it has room to grow and leaves room to the extent,
+// of another file most likely, that ends before the run.
+// Either way the file reserves the EXTRUNBLOCKS - 1 blocks after
+// the new one as its preallocation window (ip->pstart, ip->plen),
+// and takes its next blocks from there, so that files appended to
+// a little at a time, side by side, still get runs that long.
+
+// Look for file block bn in the n extents e, the first of which
+// maps file block *fbn. If it is not there, advance *fbn past
+// them and return 0.
+static uint
+efind(struct extent *e, int n, uint *fbn, uint bn) {
+  int i;
+
+  for (i = 0; i < n && e[i].len; i++) {
+    if (bn < *fbn + e[i].len)
+      return e[i].start + (bn - *fbn);
+    *fbn += e[i].len;
+  }
+  return 0;
+}
+
+// The disk block after the last of the n extents e, 0 if none.
+static uint
+elast(struct extent *e, int n) {
+  int i;
+
+  for (i = 0; i < n && e[i].len; i++)
+    ;
+  return i > 0 ? e[i-1].start + e[i-1].len : 0;
+}
+
+// Append disk block addr to the n extents e. Return 0 if it
+// needs a new extent and they have no room for one.
+static int
+eadd(struct extent *e, int n, uint addr) {
+  int i;
+
+  for (i = 0; i < n && e[i].len; i++)
+    ;
+  if (i > 0 && e[i-1].start + e[i-1].len == addr) {
+    e[i-1].len++;
+    return 1;
+  }
+  if (i == n)
+    return 0;
+  e[i].start = addr;
+  e[i].len = 1;
+  return 1;
+}
+
+// Free the blocks of the n extents e.
+static void
+efree(int dev, struct extent *e, int n) {
+  uint b;
+  int i;
+
+  for (i = 0; i < n && e[i].len; i++)
+    for (b = e[i].start; b < e[i].start + e[i].len; b++)
+      bfree(dev, b);
+}
+
+// bmap() for an I_EXTENTS inode.
+// Return 0 if the disk is full.
+static uint
+emap(struct inode *ip, uint bn, int alloc) {
+  struct extent *e = (struct extent *) ip->addrs;
+  struct extentidx *idx;
+  struct buf *rbp = 0, *lbp = 0, *nbp;
+  uint fbn = 0, addr, goal, root, leaf, ahead;
+  int i = 0;
+
+  // The inode's extents, then the leaf that would hold bn:
+  // the last one starting at or before it.
+  if ((addr = efind(e, NIEXTENT, &fbn, bn)) != 0)
+    return addr;
+  if (ip->addrs[EXT_TREE]) {
+    rbp = bread(ip->dev, ip->addrs[EXT_TREE]);
+    idx = (struct extentidx *) rbp->data;
+    for (i = 0; i < NEXTIDX && idx[i].block && idx[i].fbn <= bn; i++)
+      ;
+    lbp = bread(ip->dev, idx[i-1].block);
+    fbn = idx[i-1].fbn;
+    e = (struct extent *) lbp->data;
+    addr = efind(e, NEXTLEAF, &fbn, bn);
+  }
+
+  if (addr == 0 && alloc) {
+    if (bn != fbn)
+      panic("emap: hole");
+    goal = elast(e, lbp ? NEXTLEAF : NIEXTENT);
+    if (ip->plen > 0 && ip->pstart == goal) {
+      addr = bclaim(ip->dev, goal);
+      ip->pstart++;
+      ip->plen--;
+    } else {
+      bunreserve(ip);
+      ahead = EXTRUNBLOCKS - 1;
+      if ((addr = ballocrun(ip->dev, goal, 2 * EXTRUNBLOCKS, &ahead)) != 0) {
+        ip->pstart = addr + 1;
+        ip->plen = ahead;
+      }
+    }
+    if (addr != 0 && eadd(e, lbp ? NEXTLEAF : NIEXTENT, addr)) {
+      if (lbp)
+        log_write(lbp);
+    } else if (addr != 0) {
+      // No room for another extent: start a new leaf.
+      if (i == NEXTIDX)
+        panic("emap: out of extents");
+      root = rbp ? ip->addrs[EXT_TREE] : balloc(ip->dev);
+      leaf = root ? balloc(ip->dev) : 0;
+      if (leaf == 0) {
+        // Disk full: give back what the block would have needed.
+        if (root && rbp == 0)
+          bfree(ip->dev, root);
+        bfree(ip->dev, addr);
+        addr = 0;
+      } else {
+        if (rbp == 0) {
+          ip->addrs[EXT_TREE] = root;
+          rbp = bread(ip->dev, root);
+        }
+        idx = (struct extentidx *) rbp->data;
+        idx[i].fbn = bn;
+        idx[i].block = leaf;
+        log_write(rbp);
+        nbp = bread(ip->dev, leaf);
+        eadd((struct extent *) nbp->data, NEXTLEAF, addr);
+        log_write(nbp);
+        brelse(nbp);
+      }
+    }
+  }
+  if (lbp)
+    brelse(lbp);
+  if (rbp)
+    brelse(rbp);
+  return addr;
+}
+
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, bmap allocates one, or returns 0
+// if alloc is not set or the disk is full.
+static uint
+bmap(struct inode *ip, uint bn, int alloc) {
+  uint addr;
+
+  if (ip->flags & I_EXTENTS)
+    return emap(ip, bn, alloc);
 
   if (bn < NDIRECT) {
-    if ((addr = ip->addrs[bn]) == NULL)
+    if ((addr = ip->addrs[bn]) == NULL && alloc)
       ip->addrs[bn] = addr = balloc(ip->dev);
     return addr;
   }
@@ -385,24 +720,53 @@ bmap(struct inode *ip, uint bn) {
 
   if (bn < NINDIRECT) {
     // Load indirect block, allocating if necessary.
-    if ((addr = ip->addrs[IND_BLOCK]) == NULL)
-      ip->addrs[IND_BLOCK] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint *) bp->data;
-    if ((addr = a[bn]) == NULL) {
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
+    if ((addr = ip->addrs[IND_BLOCK]) == NULL) {
+      if (!alloc || (addr = balloc(ip->dev)) == 0)
+        return 0;
+      ip->addrs[IND_BLOCK] = addr;
     }
-    brelse(bp);
-    return addr;
+    return bindirect(ip, addr, bn, alloc);
   }
-
   bn -= NINDIRECT;
 
+  if (bn < NDINDIRECT) {
+    // Load the double-indirect block, then the indirect one.
+    if ((addr = ip->addrs[DIND_BLOCK]) == NULL) {
+      if (!alloc || (addr = balloc(ip->dev)) == 0)
+        return 0;
+      ip->addrs[DIND_BLOCK] = addr;
+    }
+    if ((addr = bindirect(ip, addr, bn / NINDIRECT, alloc)) == NULL)
+      return 0;
+    return bindirect(ip, addr, bn % NINDIRECT, alloc);
+  }
+
 
   panic("bmap: out of range");
 }
 
+// Free indirect block addr and the blocks it lists, which
+// are indirect blocks themselves depth - 1 levels down.
+static void
+bfreeind(int dev, uint addr, int depth) {
+  struct buf *bp;
+  uint *a;
+  int j;
+
+  bp = bread(dev, addr);
+  a = (uint *) bp->data;
+  for (j = 0; j < NINDIRECT; j++) {
+    if (a[j] == 0)
+      continue;
+    if (depth > 1)
+      bfreeind(dev, a[j], depth - 1);
+    else
+      bfree(dev, a[j]);
+  }
+  brelse(bp);
+  bfree(dev, addr);
+}
+
 // Truncate inode (discard contents).
 // Only called when the inode has no links
 // to it (no directory entries referring to it)
@@ -410,9 +774,30 @@ bmap(struct inode *ip, uint bn) {
 // not an open file or current directory).
 static void
 itrunc(struct inode *ip) {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  struct extentidx *idx;
+  struct buf *rbp, *lbp;
+  int i;
+
+  if (ip->flags & I_EXTENTS) {
+    bunreserve(ip);
+    efree(ip->dev, (struct extent *) ip->addrs, NIEXTENT);
+    if (ip->addrs[EXT_TREE]) {
+      rbp = bread(ip->dev, ip->addrs[EXT_TREE]);
+      idx = (struct extentidx *) rbp->data;
+      for (i = 0; i < NEXTIDX && idx[i].block; i++) {
+        lbp = bread(ip->dev, idx[i].block);
+        efree(ip->dev, (struct extent *) lbp->data, NEXTLEAF);
+        brelse(lbp);
+        bfree(ip->dev, idx[i].block);
+      }
+      brelse(rbp);
+      bfree(ip->dev, ip->addrs[EXT_TREE]);
+    }
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
 
   for (i = 0; i < NDIRECT; i++) {
     if (ip->addrs[i]) {
@@ -421,22 +806,68 @@ itrunc(struct inode *ip) {
     }
   }
 
-  if (ip->addrs[NDIRECT]) {
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint *) bp->data;
-    for (j = 0; j < NINDIRECT; j++) {
-      if (a[j])
-        bfree(ip->dev, a[j]);
-    }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+  if (ip->addrs[IND_BLOCK]) {
+    bfreeind(ip->dev, ip->addrs[IND_BLOCK], 1);
+    ip->addrs[IND_BLOCK] = 0;
+  }
+  if (ip->addrs[DIND_BLOCK]) {
+    bfreeind(ip->dev, ip->addrs[DIND_BLOCK], 2);
+    ip->addrs[DIND_BLOCK] = 0;
   }
 
   ip->size = 0;
   iupdate(ip);
 }
 
+// Count the extents among the n extents e that do not carry on
+// from the disk block *next, the one after the previous extent.
+static uint
+eruns(struct extent *e, int n, uint *next) {
+  uint runs = 0;
+  int i;
+
+  for (i = 0; i < n && e[i].len; i++) {
+    if (e[i].start != *next)
+      runs++;
+    *next = e[i].start + e[i].len;
+  }
+  return runs;
+}
+
+// Count the runs of consecutive disk blocks holding ip's data:
+// from its extents, or block by block for a block-mapped inode.
+// Caller must hold ip->lock.
+uint
+iruns(struct inode *ip) {
+  struct extentidx *idx;
+  struct buf *rbp, *lbp;
+  uint bn, addr, prev = 0, runs = 0;
+  int i;
+
+  if (ip->type == T_DEV)
+    return 0;
+  if (ip->flags & I_EXTENTS) {
+    runs = eruns((struct extent *) ip->addrs, NIEXTENT, &prev);
+    if (ip->addrs[EXT_TREE]) {
+      rbp = bread(ip->dev, ip->addrs[EXT_TREE]);
+      idx = (struct extentidx *) rbp->data;
+      for (i = 0; i < NEXTIDX && idx[i].block; i++) {
+        lbp = bread(ip->dev, idx[i].block);
+        runs += eruns((struct extent *) lbp->data, NEXTLEAF, &prev);
+        brelse(lbp);
+      }
+      brelse(rbp);
+    }
+    return runs;
+  }
+  for (bn = 0; bn < (ip->size + BSIZE - 1) / BSIZE; bn++) {
+    if ((addr = bmap(ip, bn, 0)) != prev + 1)
+      runs++;
+    prev = addr;
+  }
+  return runs;
+}
+
 // Copy stat information from inode.
 // Caller must hold ip->lock.
 void
@@ -448,6 +879,51 @@ stati(struct inode *ip, struct stat *st) {
   st->size = ip->size;
 }
 
+// Start reading blocks [bn, bn+n) of ip into the buffer cache,
+// without waiting for them. Stops at the end of the file.
+// Caller must hold ip->lock.
+void
+readahead(struct inode *ip, uint bn, uint n) {
+  uint end = (ip->size + BSIZE - 1) / BSIZE;
+  uint addr;
+
+  if (ip->type == T_DEV)
+    return;
+  for (; bn < end && n > 0; bn++, n--)
+    if ((addr = bmap(ip, bn, 0)) != 0)
+      breadahead(ip->dev, addr);
+}
+
+// Drop ip's blocks from the buffer cache, except those in use.
+// Caller must hold ip->lock.
+void
+iuncache(struct inode *ip) {
+  struct extentidx *idx;
+  struct buf *bp;
+  uint bn, addr, i;
+
+  if (ip->type == T_DEV)
+    return;
+  for (bn = 0; bn < (ip->size + BSIZE - 1) / BSIZE; bn++)
+    if ((addr = bmap(ip, bn, 0)) != 0)
+      binval(ip->dev, addr);
+  if ((ip->flags & I_EXTENTS) && ip->addrs[EXT_TREE]) {
+    bp = bread(ip->dev, ip->addrs[EXT_TREE]);
+    idx = (struct extentidx *) bp->data;
+    for (i = 0; i < NEXTIDX && idx[i].block; i++)
+      binval(ip->dev, idx[i].block);
+    brelse(bp);
+  }
+  if (ip->addrs[IND_BLOCK])
+    binval(ip->dev, ip->addrs[IND_BLOCK]);
+  if (ip->addrs[DIND_BLOCK]) {
+    for (i = 0; i < NINDIRECT; i++)
+      if ((addr = bindirect(ip, ip->addrs[DIND_BLOCK], i, 0)) != 0)
+        binval(ip->dev, addr);
+    binval(ip->dev, ip->addrs[DIND_BLOCK]);
+  }
+}
+
 //PAGEBREAK!
 // Read data from inode.
 // Caller must hold ip->lock.
@@ -467,8 +943,13 @@ readi(struct inode *ip, char *dst, uint off, uint n) {
   if (off + n > ip->size)
     n = ip->size - off;
 
+  // Queue all blocks of a multi-block read before waiting for the
+  // first, so that the disk reads ahead while earlier ones are copied.
+  if (n > 0 && off / BSIZE != (off + n - 1) / BSIZE)
+    readahead(ip, off / BSIZE, (off + n - 1) / BSIZE - off / BSIZE + 1);
+
   for (tot = 0; tot < n; tot += m, off += m, dst += m) {
-    bp = bread(ip->dev, bmap(ip, off / BSIZE));
+    bp = bread(ip->dev, bmap(ip, off / BSIZE, 1));
     m = min(n - tot, BSIZE - off % BSIZE);
     memmove(dst, bp->data + off % BSIZE, m);
     brelse(bp);
@@ -477,11 +958,12 @@ readi(struct inode *ip, char *dst, uint off, uint n) {
 }
 
 // PAGEBREAK!
-// Write data to inode.
+// Write data to inode. Return the bytes written, fewer than n
+// if the disk fills up, or -1 if none could be.
 // Caller must hold ip->lock.
 int
 writei(struct inode *ip, char *src, uint off, uint n) {
-  uint tot, m;
+  uint tot, m, addr;
   struct buf *bp;
 
   if (ip->type == T_DEV) {
@@ -492,22 +974,47 @@ writei(struct inode *ip, char *src, uint off, uint n) {
 
   if (off > ip->size || off + n < off)
     return -1;
-  if (off + n > MAXFILE * BSIZE)
+  if (n > 0 && (off + n - 1) / BSIZE >= MAXFILE)
     return -1;
 
   for (tot = 0; tot < n; tot += m, off += m, src += m) {
-    bp = bread(ip->dev, bmap(ip, off / BSIZE));
+    if ((addr = bmap(ip, off / BSIZE, 1)) == 0)
+      break;  // disk full
+    bp = bread(ip->dev, addr);
     m = min(n - tot, BSIZE - off % BSIZE);
     memmove(bp->data + off % BSIZE, src, m);
     log_write(bp);
     brelse(bp);
   }
 
-  if (n > 0 && off > ip->size) {
+  if (tot > 0 && off > ip->size) {
     ip->size = off;
     iupdate(ip);
   }
-  return n;
+  return tot > 0 || n == 0 ? tot : -1;
+}
+
+// Most log blocks a writei() of n bytes at off changes: the data
+// blocks, the indirect blocks above them (the indirect one, the
+// double-indirect one and those it lists for the range), the bitmap
+// blocks recording all of those and the inode.
+int
+writeblocks(uint off, uint n) {
+  uint nb, nind, nbitmap;
+
+  if (n == 0)
+    return 1;
+  nb = (off + n - 1) / BSIZE - off / BSIZE + 1;
+  nind = 2 + nb / NINDIRECT + 1;
+  nbitmap = sb.size / BPB + 1;
+  return nb + nind + min(nb + nind, nbitmap) + 1;
+}
+
+// Most log blocks an iput() changes, freeing the inode and its
+// blocks: the bitmap and the inode.
+int
+putblocks(void) {
+  return sb.size / BPB + 1 + 1;
 }
 
 //PAGEBREAK!
@@ -669,6 +1176,7 @@ struct {
   struct spinlock lock;
   struct file *f;
   uint bmap_size;
+  uint pagestart;  // offset of page 0: the bitmap rounded up to a block
 } swapfile;
 extern char end[];
 static inline BOOL
@@ -758,19 +1266,20 @@ int swapfile_write_page(void *src, uint i) {
 //  if ((swapfile.f->ip->size < swapfile.bmap_size + (i + 1) * PGSIZE))
 //    panic("swapfile_write_page: out of range");
 
-  fileseek(swapfile.f, swapfile.bmap_size + (i) * PGSIZE, SEEK_SET);
+  fileseek(swapfile.f, swapfile.pagestart + (i) * PGSIZE, SEEK_SET);
 
-  filewrite(swapfile.f, src, PGSIZE);
+  if (filewrite(swapfile.f, src, PGSIZE) != PGSIZE)
+    panic("swapfile_write_page: disk full");
   return 0;
 
 }; // always writes PGSIZE bytes
 int swapfile_read_page(void *dst, uint i) {
 
-  if ((swapfile.f->ip->size < swapfile.bmap_size + (i + 1) * PGSIZE) &&
-      filetruncate(swapfile.f, swapfile.bmap_size + (i + 1) * PGSIZE) < 0)
+  if ((swapfile.f->ip->size < swapfile.pagestart + (i + 1) * PGSIZE) &&
+      filetruncate(swapfile.f, swapfile.pagestart + (i + 1) * PGSIZE) < 0)
     panic("swapfile_read_page: filetruncate");
 
-  fileseek(swapfile.f, swapfile.bmap_size + (i) * PGSIZE, SEEK_SET);
+  fileseek(swapfile.f, swapfile.pagestart + (i) * PGSIZE, SEEK_SET);
 
   fileread(swapfile.f, dst, PGSIZE);
   return 0;
@@ -816,7 +1325,7 @@ void swapinit_file(void) {
 
   initlock(&swapfile.lock, "swapfile");
 
-  begin_op();
+  begin_op(MAXOPBLOCKS);
 
   if ((swapinode = ialloc(ROOTDEV, T_FILE)) == NULL)
     panic("swapinit: ialloc");
@@ -824,6 +1333,7 @@ void swapinit_file(void) {
   swapinode->major = 0;
   swapinode->minor = 0;
   swapinode->nlink = 1;
+  swapinode->flags = I_EXTENTS;
   iupdate(swapinode);
   if ((f = filealloc()) == NULL) {
     iunlockput(swapinode);
@@ -846,6 +1356,8 @@ void swapinit_file(void) {
    * */
   swapfile.bmap_size = (((uint) (P2V(PHYSTOP) - (uint) end - 1) / PGSIZE) + 1 - 1) / 8 + 1;
 
+  // Pages start on a block, so each one costs a single block.
+  swapfile.pagestart = (swapfile.bmap_size + BSIZE - 1) / BSIZE * BSIZE;
   cprintf("swapfile.bmap_size %d\n", swapfile.bmap_size);
   if (filetruncate(f, (off_t) swapfile.bmap_size) < 0)
     panic("swapinit: filetruncate");
@@ -953,6 +1465,8 @@ void swapwrite_file(const char *buf, void *la, pte_t *buf_pte) {
 
   release(&swapMap.lock);
 
+  // The page may be shared, and its address spaces loaded elsewhere.
+  tlbshootdown(0);
   reset_and_free_pa_pd(V2P(buf));
 
   cprintf("swapwrite_file: ended writing\n");
@@ -978,7 +1492,7 @@ void swapwrite(const char *buf, void *va) {
     if (!s->taken) {
 //      acquiresleep(&s->lock);
 
-      begin_op();
+      begin_op(SWBLOCKS);
 
       for (int i = 0; i < SWBLOCKS; ++i) {
         bp = bread(ROOTDEV, s->block + i);
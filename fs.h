@@ -3,7 +3,7 @@
 
 
 #define ROOTINO 1  // root i-number
-#define BSIZE 512  // block size
+#define BSIZE 4096  // block size, a page
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
@@ -21,14 +21,16 @@ struct superblock {
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
   uint swapstart;    // Block number of first swap block
+  uint bsize;        // Block size (bytes), must be BSIZE
 };
 
-#define NDIRECT 12
-#define IND_BLOCK NDIRECT
-#define DIND_BLOCK (IND_BLOCK + 1)
+#define NDIRECT 10
+#define IND_BLOCK NDIRECT              // addrs[] slot of the indirect block
+#define DIND_BLOCK (IND_BLOCK + 1)     // and of the double-indirect one
 
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)  // more than a uint offset reaches
 
 // On-disk inode structure
 struct dinode {
@@ -37,9 +39,31 @@ struct dinode {
   short minor;          // Minor device number (T_DEV only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses TODO
+  uint flags;           // I_EXTENTS
+  uint addrs[NDIRECT+2];   // Data block addresses, or extents
 };
 
+#define I_EXTENTS 0x1   // addrs[] holds extents, not block addresses
+
+// An extent maps len consecutive file blocks to the disk blocks
+// from start on. An I_EXTENTS inode keeps its first NIEXTENT
+// extents in addrs[], in file order, and the rest in leaf blocks
+// listed by the tree root block in addrs[EXT_TREE].
+struct extent {
+  uint start;
+  uint len;             // 0 for an unused slot
+};
+
+struct extentidx {
+  uint fbn;             // first file block the leaf maps
+  uint block;           // the leaf, 0 for an unused slot
+};
+
+#define NIEXTENT (NDIRECT * sizeof(uint) / sizeof(struct extent))
+#define EXT_TREE IND_BLOCK
+#define NEXTLEAF (BSIZE / sizeof(struct extent))      // extents per leaf
+#define NEXTIDX  (BSIZE / sizeof(struct extentidx))   // leaves per root
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -0,0 +1,104 @@
+//
+// File-system storm: several processes each create, write, read back
+// and unlink their own set of files, round after round. Reports
+// operations per second and the buffer cache hit rate over the run.
+// usage: fsbench [procs] [files] [rounds]
+//
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "param.h"
+#include "bcache.h"
+
+#define MAXPROCS 8
+#define FILEBLOCKS 4  // 512-byte writes per file
+
+static char buf[512];
+
+// One process's share; returns the operations done, or -1.
+static int
+storm(int p, int nfiles, int rounds) {
+  char path[16];
+  int ops = 0, fd, r, f, b;
+
+  memset(buf, 'a' + p, sizeof(buf));
+  for (r = 0; r < rounds; ++r) {
+    for (f = 0; f < nfiles; ++f) {
+      benchname(path, "fsb", p, f);
+      if ((fd = open(path, O_CREATE | O_RDWR)) < 0)
+        return -1;
+      for (b = 0; b < FILEBLOCKS; ++b)
+        if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+          return -1;
+      close(fd);
+      ops += 1 + FILEBLOCKS;
+    }
+    for (f = 0; f < nfiles; ++f) {
+      benchname(path, "fsb", p, f);
+      if ((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+      for (b = 0; b < FILEBLOCKS; ++b)
+        if (read(fd, buf, sizeof(buf)) != sizeof(buf) || buf[0] != 'a' + p)
+          return -1;
+      close(fd);
+      ops += 1 + FILEBLOCKS;
+    }
+    for (f = 0; f < nfiles; ++f) {
+      benchname(path, "fsb", p, f);
+      if (unlink(path) < 0)
+        return -1;
+      ops++;
+    }
+  }
+  return ops;
+}
+
+int main(int argc, char **argv) {
+  struct bcachestat before, after;
+  int nprocs, nfiles, rounds, i, t0, t, ops, total = 0, failed = 0;
+  int fds[MAXPROCS][2];
+  uint hits, lookups;
+
+  nprocs = argc > 1 ? atoi(argv[1]) : 4;
+  nfiles = argc > 2 ? atoi(argv[2]) : 10;
+  rounds = argc > 3 ? atoi(argv[3]) : 5;
+  if (nprocs < 1 || nprocs > MAXPROCS || nfiles < 1 || rounds < 1) {
+    printf(STDERR, "usage: fsbench [procs] [files] [rounds]\n");
+    exit();
+  }
+
+  bcachestat(&before);
+  t0 = uptime();
+  for (i = 0; i < nprocs; ++i) {
+    pipe(fds[i]);
+    if (fork() == 0) {
+      ops = storm(i, nfiles, rounds);
+      write(fds[i][1], &ops, sizeof(ops));
+      exit();
+    }
+  }
+  for (i = 0; i < nprocs; ++i) {
+    read(fds[i][0], &ops, sizeof(ops));
+    wait();
+    if (ops < 0)
+      failed = 1;
+    else
+      total += ops;
+  }
+  t = uptime() - t0;
+  bcachestat(&after);
+
+  hits = after.hits - before.hits;
+  lookups = hits + after.misses - before.misses;
+  printf(STDOUT, "fsbench: %d procs x %d files x %d rounds\n", nprocs, nfiles, rounds);
+  printf(STDOUT, "%d ops in %d ticks: %d ops/s\n", total, t, t ? total * HZ / t : 0);
+  printf(STDOUT, "bcache: %d buffers of %d, hit rate %d.%d%%, %d evictions\n",
+         after.nbuf, after.max, lookups ? hits * 100 / lookups : 0,
+         lookups ? hits * 1000 / lookups % 10 : 0, after.evictions - before.evictions);
+  if (failed)
+    printf(STDOUT, "fsbench FAILED\n");
+  else
+    printf(STDOUT, "fsbench OK\n");
+  exit();
+}
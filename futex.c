@@ -0,0 +1,107 @@
+// Futexes: sleep until another thread changes a word of user memory.
+//
+// A waiter is keyed on its page table and the virtual address of the
+// word, so the threads of a process meet on the same futex wherever
+// the page is in physical memory, even after it was swapped out and
+// back in. Every key with waiters has a slot in futex.q; the slot is
+// the sleep channel, and futex.lock is the lock sleep() drops, so a
+// wake between reading the word and sleeping cannot be lost.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "futex.h"
+
+#define NFUTEX NPROC  // every process can wait on its own word
+
+struct futexq {
+  pde_t *pgdir;
+  uint va;
+  int waiters;        // slot is free at 0
+};
+
+static struct {
+  struct spinlock lock;
+  struct futexq q[NFUTEX];
+} futex;
+
+void
+futexinit(void)
+{
+  initlock(&futex.lock, "futex");
+}
+
+// Caller holds futex.lock.
+static struct futexq*
+futexlookup(pde_t *pgdir, uint va)
+{
+  struct futexq *q;
+
+  for(q = futex.q; q < &futex.q[NFUTEX]; q++)
+    if(q->waiters > 0 && q->pgdir == pgdir && q->va == va)
+      return q;
+  return 0;
+}
+
+// Sleep on the user word at va if it still holds val.
+// Returns 0 when woken, -1 if the word held something else.
+int
+futexwait(uint va, uint val)
+{
+  struct proc *p = myproc();
+  struct futexq *q;
+  char *page;
+  pte_t *pte;
+
+  if(va % 4 != 0 || va + 4 < va || va + 4 > p->sz)
+    return -1;
+  // The word must be read with futex.lock held, without faulting.
+  for(;;){
+    if(faultin(va) < 0)
+      return -1;
+    acquire(&futex.lock);
+    if((page = uva2ka(p->pgdir, (char*)va)) != 0)
+      break;
+    pte = walkpgdir(p->pgdir, (char*)va, 0);
+    release(&futex.lock);
+    if(pte != 0 && (*pte & PTE_P))
+      return -1;  // not the user's: the stack guard page
+    // swapped out meanwhile: fault it in again
+  }
+  if(*(uint*)(page + va % PGSIZE) != val){
+    release(&futex.lock);
+    return -1;
+  }
+  if((q = futexlookup(p->pgdir, va)) == 0){
+    for(q = futex.q; q < &futex.q[NFUTEX] && q->waiters > 0; q++)
+      ;
+    if(q == &futex.q[NFUTEX])
+      panic("futexwait");
+    q->pgdir = p->pgdir;
+    q->va = va;
+  }
+  q->waiters++;
+  sleep(q, &futex.lock);
+  q->waiters--;
+  release(&futex.lock);
+  return 0;
+}
+
+// Wake up to n processes waiting on the user word at va.
+// Returns how many were woken.
+int
+futexwake(uint va, int n)
+{
+  struct futexq *q;
+  int woken = 0;
+
+  acquire(&futex.lock);
+  if((q = futexlookup(myproc()->pgdir, va)) != 0)
+    woken = wakeupn(q, n);
+  release(&futex.lock);
+  return woken;
+}
@@ -0,0 +1,8 @@
+#ifndef XV6_PUBLIC_FUTEX_H
+#define XV6_PUBLIC_FUTEX_H
+
+// futex() operations, shared by the kernel and user programs.
+#define FUTEX_WAIT  0   // sleep if *addr == val
+#define FUTEX_WAKE  1   // wake up to val sleepers on addr
+
+#endif //XV6_PUBLIC_FUTEX_H
@@ -0,0 +1,124 @@
+//
+// Futex locks: a mutex must keep a shared counter exact under
+// contention, and handing a lock back and forth between two threads
+// with a mutex and condition variable is timed against doing the same
+// with a semaphore made of a pipe.
+// usage: futexbench [handoffs]
+//
+#include "types.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "futex.h"
+
+#define NTHREADS 4
+#define INCS 20000
+
+static struct mutex m;
+static struct cond c;
+static volatile int turn, counter;
+static int rounds;
+static int sem[2][2];  // pipe semaphores: read is P, write is V
+
+static void
+incr(void *arg) {
+  for (int i = 0; i < INCS; ++i) {
+    mutex_lock(&m);
+    counter++;
+    mutex_unlock(&m);
+  }
+}
+
+// Thread me waits for its turn, then hands it to the other one.
+static void
+pingpong(void *arg) {
+  int me = (int) arg;
+
+  for (int i = 0; i < rounds; ++i) {
+    mutex_lock(&m);
+    while (turn != me)
+      cond_wait(&c, &m);
+    turn = !me;
+    cond_signal(&c);
+    mutex_unlock(&m);
+  }
+}
+
+static void
+pipepong(void *arg) {
+  int me = (int) arg;
+  char t = 0;
+
+  for (int i = 0; i < rounds; ++i) {
+    read(sem[me][0], &t, 1);
+    write(sem[!me][1], &t, 1);
+  }
+}
+
+// Run fn(0) and fn(1) in two threads; return the cycles per handoff.
+static uint
+handoff(void (*fn)(void *)) {
+  uint64 c0 = rdtsc();
+
+  thread_create(fn, (void *) 0);
+  thread_create(fn, (void *) 1);
+  thread_join();
+  thread_join();
+  return cyclesper(rdtsc() - c0, 2 * rounds);
+}
+
+// FUTEX_WAIT on a word the process may not use must fail, not spin:
+// one whose end wraps around, and one on the stack guard page.
+static int
+badaddr(void) {
+  int local;
+  uint guard = PGROUNDDOWN((uint) &local) - PGSIZE;
+
+  return futex((volatile uint *) 0xfffffffc, FUTEX_WAIT, 0) == -1 &&
+         futex((volatile uint *) guard, FUTEX_WAIT, 0) == -1;
+}
+
+int main(int argc, char **argv) {
+  uint64 c0;
+  uint fast, viafutex, viapipe;
+  int i;
+  char t = 0;
+
+  rounds = argc > 1 ? atoi(argv[1]) : 10000;
+  if (rounds <= 0) {
+    printf(STDERR, "usage: futexbench [handoffs]\n");
+    exit();
+  }
+  mutex_init(&m);
+  cond_init(&c);
+
+  c0 = rdtsc();
+  for (i = 0; i < 100000; ++i) {
+    mutex_lock(&m);
+    mutex_unlock(&m);
+  }
+  fast = cyclesper(rdtsc() - c0, 100000);
+
+  for (i = 0; i < NTHREADS; ++i)
+    thread_create(incr, 0);
+  for (i = 0; i < NTHREADS; ++i)
+    thread_join();
+
+  turn = 0;
+  viafutex = handoff(pingpong);
+  pipe(sem[0]);
+  pipe(sem[1]);
+  write(sem[0][1], &t, 1);  // thread 0 goes first
+  viapipe = handoff(pipepong);
+
+  printf(STDOUT, "futexbench: uncontended lock+unlock %d cycles\n", fast);
+  printf(STDOUT, "futexbench: handoff %d cycles with futex, %d with pipe\n",
+         viafutex, viapipe);
+  if (counter != NTHREADS * INCS)
+    printf(STDOUT, "futexbench: counter %d, expected %d FAILED\n", counter, NTHREADS * INCS);
+  else if (!badaddr())
+    printf(STDOUT, "futexbench: wait on a bad address FAILED\n");
+  else
+    printf(STDOUT, "futexbench OK\n");
+  exit();
+}
@@ -0,0 +1,98 @@
+//
+// A barrier-heavy parallel job next to CPU hogs, scheduled
+// independently and then as a gang. The worker threads spin on a
+// sense-reversing barrier after every round of work, so a round lasts
+// until the last of them gets a CPU.
+// usage: gangbench [threads] [rounds] [hogs]
+// Needs more than one CPU (make qemu CPUS=4).
+//
+#include "types.h"
+#include "user.h"
+#include "x86.h"
+
+#define MAXTHREADS 8
+#define MAXHOGS 8
+#define WORK 20000  // loop iterations per round
+
+static int nthreads, rounds;
+static volatile uint arrived, sense;
+
+// Wait for every worker; the last one to arrive releases the others.
+static void
+barrier(uint *local) {
+  *local = !*local;
+  if (xadd(&arrived, 1) == nthreads - 1) {
+    arrived = 0;
+    sense = *local;
+  } else {
+    while (sense != *local)
+      ;
+  }
+}
+
+static void
+worker(void *arg) {
+  volatile uint x = 0;
+  uint local = 0;
+
+  for (int r = 0; r < rounds; ++r) {
+    for (int i = 0; i < WORK; ++i)
+      x += i;
+    barrier(&local);
+  }
+}
+
+// Run the job with the workers in gang (0 for none); return the
+// cycles per round and set *t to the ticks it took.
+static uint
+job(int gang, int *t) {
+  uint64 c0;
+  int t0, i;
+
+  setgang(0, gang);  // the threads inherit it
+  arrived = sense = 0;
+  t0 = uptime();
+  c0 = rdtsc();
+  for (i = 0; i < nthreads; ++i)
+    thread_create(worker, 0);
+  for (i = 0; i < nthreads; ++i)
+    thread_join();
+  *t = uptime() - t0;
+  setgang(0, 0);
+  return cyclesper(rdtsc() - c0, rounds);
+}
+
+int main(int argc, char **argv) {
+  int hogs[MAXHOGS];
+  int nhogs, i, tind, tgang;
+  uint ind, gang;
+
+  nthreads = argc > 1 ? atoi(argv[1]) : 2;
+  rounds = argc > 2 ? atoi(argv[2]) : 500;
+  nhogs = argc > 3 ? atoi(argv[3]) : 2;
+  if (nthreads < 1 || nthreads > MAXTHREADS || rounds <= 0 ||
+      nhogs < 0 || nhogs > MAXHOGS) {
+    printf(STDERR, "usage: gangbench [threads] [rounds] [hogs]\n");
+    exit();
+  }
+
+  for (i = 0; i < nhogs; ++i) {
+    if ((hogs[i] = fork()) == 0) {
+      for (;;)
+        ;
+    }
+  }
+
+  ind = job(0, &tind);
+  gang = job(getpid(), &tgang);
+
+  for (i = 0; i < nhogs; ++i)
+    kill(hogs[i]);
+  for (i = 0; i < nhogs; ++i)
+    wait();
+
+  printf(STDOUT, "gangbench: %d threads, %d rounds, %d hogs\n", nthreads, rounds, nhogs);
+  printf(STDOUT, "independent: %d cycles/round, %d ticks\n", ind, tind);
+  printf(STDOUT, "gang:        %d cycles/round, %d ticks\n", gang, tgang);
+  exit();
+}
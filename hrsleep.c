@@ -0,0 +1,56 @@
+//
+// nanosleep() accuracy: sleeps of a few microseconds up to a couple of
+// ticks, measured with monotime(). Prints the mean and worst overshoot.
+// usage: hrsleep [iterations]
+//
+#include "types.h"
+#include "user.h"
+#include "date.h"
+
+static int durations[] = { 50, 200, 1000, 3000, 15000 };  // us
+
+// b - a in microseconds
+static int
+elapsed(struct timespec *a, struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1000000 +
+         ((int) b->tv_nsec - (int) a->tv_nsec) / 1000;
+}
+
+int main(int argc, char **argv) {
+  int n = argc > 1 ? atoi(argv[1]) : 20;
+  struct timespec req, t0, t1;
+  int i, j, us, late, sum, worst, fail = 0;
+
+  if (n <= 0) {
+    printf(STDERR, "usage: hrsleep [iterations]\n");
+    exit();
+  }
+  for (i = 0; i < sizeof(durations) / sizeof(durations[0]); ++i) {
+    req.tv_sec = durations[i] / 1000000;
+    req.tv_nsec = durations[i] % 1000000 * 1000;
+    sum = worst = 0;
+    for (j = 0; j < n; ++j) {
+      monotime(&t0);
+      if (nanosleep(&req) < 0) {
+        printf(STDERR, "hrsleep: nanosleep failed\n");
+        exit();
+      }
+      monotime(&t1);
+      us = elapsed(&t0, &t1);
+      if (us < durations[i])
+        fail = 1;
+      late = us - durations[i];
+      sum += late;
+      if (late > worst)
+        worst = late;
+    }
+    printf(STDOUT, "hrsleep: %d us x %d: mean +%d us, worst +%d us\n",
+           durations[i], n, sum / n, worst);
+  }
+  req.tv_sec = 0;
+  req.tv_nsec = 1000000000;
+  if (nanosleep(&req) != -1)
+    fail = 1;
+  printf(STDOUT, fail ? "hrsleep: FAILED\n" : "hrsleep: OK\n");
+  exit();
+}
@@ -1,4 +1,9 @@
 // Simple PIO-based (non-DMA) IDE driver code.
+// A block is several sectors; the disks are put in multiple mode
+// with one block per DRQ, so that a block costs one command and
+// one interrupt. Queued requests for consecutive blocks in the same
+// direction are merged into one command of up to IDEMAXRUN blocks,
+// which interrupts once per block.
 
 #include "types.h"
 #include "defs.h"
@@ -23,6 +28,13 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+
+#define SECTOR_PER_BLOCK (BSIZE/SECTOR_SIZE)
+#define IDEMAXRUN 16  // most blocks one command transfers
+#if SECTOR_PER_BLOCK > 16
+#error "a block must fit one multiple-mode transfer"
+#endif
 
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
@@ -30,6 +42,8 @@
 
 static struct spinlock idelock;
 static struct buf *idequeue;
+static int iderun;      // blocks the running command has left, idequeue first
+static uint idecmds;    // commands issued
 
 static int havedisk1;
 static void idestart(struct buf*);
@@ -47,6 +61,18 @@ idewait(int checkerr)
   return 0;
 }
 
+// Transfer a whole block per DRQ on disk d.
+static void
+idesetmul(int d)
+{
+  outb(0x1f6, 0xe0 | (d<<4));
+  idewait(0);
+  outb(0x1f2, SECTOR_PER_BLOCK);
+  outb(0x1f7, IDE_CMD_SETMUL);
+  if(idewait(1) < 0)
+    panic("ideinit: multiple mode");
+}
+
 void
 ideinit(void)
 {
@@ -67,26 +93,39 @@ ideinit(void)
 
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
+
+  if(SECTOR_PER_BLOCK > 1){
+    outb(0x3f6, 2);  // no interrupts until the first request
+    for(i = 0; i <= havedisk1; i++)
+      idesetmul(i);
+  }
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Start the request for b, and the ones queued behind it
+// for the following blocks.  Caller must hold idelock.
 static void
 idestart(struct buf *b)
 {
+  struct buf *q;
+
   if(b == 0)
     panic("idestart");
   if(b->blockno >= FSSIZE)
     panic("incorrect blockno");
-  int sector_per_block =  BSIZE/SECTOR_SIZE;
-  int sector = b->blockno * sector_per_block;
-  int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
-  int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
+  int sector = b->blockno * SECTOR_PER_BLOCK;
+  int read_cmd = (SECTOR_PER_BLOCK == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
+  int write_cmd = (SECTOR_PER_BLOCK == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
-  if (sector_per_block > 7) panic("idestart");
+  for(iderun = 1, q = b; iderun < IDEMAXRUN && q->qnext; iderun++, q = q->qnext){
+    if(q->qnext->dev != b->dev || q->qnext->blockno != q->blockno + 1 ||
+       (q->qnext->flags & B_DIRTY) != (b->flags & B_DIRTY))
+      break;
+  }
+  idecmds++;
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, iderun * SECTOR_PER_BLOCK);  // number of sectors
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
@@ -118,13 +157,21 @@ ideintr(void)
   if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
     insl(0x1f0, b->data, BSIZE/4);
 
-  // Wake process waiting for this buf.
+  // Wake process waiting for this buf,
+  // or release it if nobody waits for it.
   b->flags |= B_VALID;
   b->flags &= ~B_DIRTY;
-  wakeup(b);
-
-  // Start disk on next buf in queue.
-  if(idequeue != 0)
+  if(b->flags & B_ASYNC)
+    bdone(b);
+  else
+    wakeup(b);
+
+  // Go on with the next block of the command, or start
+  // disk on next buf in queue.
+  if(--iderun > 0){
+    if(idequeue->flags & B_DIRTY)
+      outsl(0x1f0, idequeue->data, BSIZE/4);
+  } else if(idequeue != 0)
     idestart(idequeue);
 
   release(&idelock);
@@ -134,6 +181,7 @@ ideintr(void)
 // Sync buf with disk.
 // If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
 // Else if B_VALID is not set, read buf from disk, set B_VALID.
+// If B_ASYNC is set, only queue the request: ideintr() completes it.
 void
 iderw(struct buf *b)
 {
@@ -158,11 +206,18 @@ iderw(struct buf *b)
   if(idequeue == b)
     idestart(b);
 
-  // Wait for request to finish.
-  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
+  // Wait for request to finish, unless nobody waits for it.
+  while((b->flags & B_ASYNC) == 0 && (b->flags & (B_VALID|B_DIRTY)) != B_VALID){
     sleep(b, &idelock);
   }
 
 
   release(&idelock);
 }
+
+// Number of disk commands issued so far.
+uint
+iderequests(void)
+{
+  return idecmds;
+}
@@ -129,6 +129,10 @@ kalloc(void) {
     // here i am hoping that refcount was set to zero - it had to be by kfree
     if (inc_ref_pa(V2P(r)) != 1)
       panic("kalloc: inc_ref_pa");
+    phys_page_data.data[V2P(r) / PGSIZE].ksm = FALSE;
+    phys_page_data.data[V2P(r) / PGSIZE].cksum = 0;
+    phys_page_data.data[V2P(r) / PGSIZE].young = FALSE;
+    phys_page_data.data[V2P(r) / PGSIZE].lastref = idlepass;
   } else {
     // TODO try to get a page that was swapped out
     // swapvictim();
@@ -0,0 +1,131 @@
+// Idle page tracking and working-set estimation.
+//
+// kidled wakes up every interval ticks and samples the accessed bit of
+// every resident user page, clearing it as it goes. A page found
+// accessed records the current pass in page_data_t.lastref, so its
+// age is the number of passes since it was last used. The working set
+// over a window of 2^k passes is the number of pages younger than that.
+//
+// Clearing PTE_A would hide the access from swap(); kidled sets
+// page_data_t.young instead, and swap() consumes both in pte_young().
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "stateinfo.h"
+
+extern struct {
+  struct spinlock lock;
+  struct proc proc[NPROC];
+} ptable;
+
+uint idlepass;
+static int interval = IDLEINTERVAL;
+
+// Processes that are running, or whose threads are, may have
+// translations cached in a TLB, and would look idle until the entry
+// is evicted: sample them next time.
+static int
+sampleable(struct proc *p)
+{
+  return (p->state == SLEEPING || p->state == RUNNABLE) && p->sz > 0 &&
+         !vmrunning(p->pgdir);
+}
+
+// Age the pages of p and recompute its working sets. Caller holds ptable.lock.
+static void
+sample(struct proc *p)
+{
+  uint count[NWSSWIN];
+  page_data_t *pd;
+  pte_t *pte;
+  uint a, age;
+  int k;
+
+  memset(count, 0, sizeof(count));
+  for(a = 0; a < p->sz; a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (void*)a, FALSE)) == 0){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if((*pte & (PTE_P | PTE_U)) != (PTE_P | PTE_U))
+      continue;
+    pd = get_pd(PTE_ADDR(*pte));
+    if(*pte & PTE_A){
+      *pte &= ~PTE_A;
+      pd->young = TRUE;
+      pd->lastref = idlepass;
+    }
+    age = idlepass - pd->lastref;
+    for(k = 0; k < NWSSWIN; k++)
+      if(age < (1 << k))
+        count[k]++;
+  }
+  memmove(p->wss, count, sizeof(count));
+  p->wsssamples++;
+}
+
+// The kidled kernel thread.
+void
+kidled(void)
+{
+  struct proc *p;
+
+  for(;;){
+    ticksleep(interval);
+
+    idlepass++;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      acquire(&ptable.lock);
+      if(sampleable(p))
+        sample(p);
+      release(&ptable.lock);
+    }
+  }
+}
+
+// Set the sampling interval in ticks and return the old one.
+// A non-positive value only queries it.
+int
+setidleinterval(int n)
+{
+  int old = interval;
+
+  if(n > 0)
+    interval = n;
+  return old;
+}
+
+// Fill wi with the working-set estimate of process pid (0 for the caller).
+int
+wssget(int pid, struct wssinfo *wi)
+{
+  struct proc *p;
+  uint resident, swapped, locked;
+  int k;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid != pid || p->state == UNUSED || p->state == EMBRYO)
+      continue;
+    wi->pid = pid;
+    wi->interval = interval;
+    wi->samples = p->wsssamples;
+    for(k = 0; k < NWSSWIN; k++){
+      wi->window[k] = interval << k;
+      wi->wss[k] = p->wss[k] * PGSIZE;
+    }
+    countuvm(p->pgdir, p->sz, &resident, &swapped, &locked);
+    wi->resident = resident * PGSIZE;
+    release(&ptable.lock);
+    return 0;
+  }
+  release(&ptable.lock);
+  return -1;
+}
@@ -0,0 +1,283 @@
+// Kernel same-page merging.
+//
+// ksmd walks the user pages of every process a few at a time and merges
+// pages with identical contents into one read-only frame mapped PTE_C,
+// the same way fork() shares pages. A write to a merged page takes the
+// usual copy_on_write() path and gets a private copy back.
+//
+// Merged frames are kept in the stable table. A page only becomes a
+// merge candidate once its checksum has stayed the same for a whole
+// pass; candidates go into the unstable table, which is thrown away
+// at the end of every pass, as in Linux.
+//
+// ksmd only touches processes that are SLEEPING or RUNNABLE, with no
+// running thread sharing their page table, and holds ptable.lock while
+// doing so: such a process cannot start running, and no CPU has its
+// translations cached, so its PTEs can be rewritten without a TLB
+// shootdown.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "ksm.h"
+
+#define NKSMHASH 64
+
+extern struct {
+  struct spinlock lock;
+  struct proc proc[NPROC];
+} ptable;
+
+struct ksmnode {
+  uint pa;
+  uint sum;
+  struct proc *p;   // unstable only: where the candidate is mapped
+  int pid;
+  uint va;
+  struct ksmnode *next;
+};
+
+// Protected by ptable.lock.
+static struct {
+  struct ksmnode node[NKSMPAGES];
+  struct ksmnode *freelist;
+  struct ksmnode *stable[NKSMHASH];
+  struct ksmnode *unstable[NKSMHASH];
+  struct proc *p;   // scan cursor
+  uint va;
+  struct ksmstat stat;
+} ksm;
+
+static uint
+cksum(char *v)
+{
+  uint *w = (uint*)v;
+  uint h = 2166136261;
+  int i;
+
+  for(i = 0; i < PGSIZE/sizeof(uint); i++)
+    h = (h ^ w[i]) * 16777619;
+  return h;
+}
+
+static struct ksmnode*
+nodealloc(void)
+{
+  struct ksmnode *n;
+
+  if((n = ksm.freelist) != NULL)
+    ksm.freelist = n->next;
+  return n;
+}
+
+static void
+nodefree(struct ksmnode *n)
+{
+  n->next = ksm.freelist;
+  ksm.freelist = n;
+}
+
+// Only processes that are not running and cannot start running
+// while we hold ptable.lock are scanned.
+static int
+scannable(struct proc *p)
+{
+  return (p->state == SLEEPING || p->state == RUNNABLE) && p->sz > 0 &&
+         !vmrunning(p->pgdir);
+}
+
+static int
+stablevalid(struct ksmnode *n)
+{
+  return get_pd(n->pa)->ksm && get_ref_pa(n->pa) > 0;
+}
+
+// Return the PTE that still maps unstable candidate n,
+// or 0 if it was unmapped, written or shared since.
+static pte_t*
+unstablepte(struct ksmnode *n)
+{
+  pte_t *pte;
+
+  if(n->p->pid != n->pid || !scannable(n->p) || n->va >= n->p->sz)
+    return 0;
+  pte = walkpgdir(n->p->pgdir, (void*)n->va, FALSE);
+  if(pte == 0 || !(*pte & PTE_P) || (*pte & PTE_L) || PTE_ADDR(*pte) != n->pa)
+    return 0;
+  if(get_ref_pa(n->pa) != 1)
+    return 0;
+  return pte;
+}
+
+// Point pte at the merged frame spa and drop the page it mapped.
+static void
+merge(pte_t *pte, uint spa)
+{
+  uint pa = PTE_ADDR(*pte);
+
+  inc_ref_pa(spa);
+  *pte = spa | (PTE_FLAGS(*pte) & ~PTE_W) | PTE_C;
+  kfree(P2V(pa));
+}
+
+// Try to merge the page mapped by pte at va in p.
+static void
+ksmpage(struct proc *p, uint va, pte_t *pte)
+{
+  struct ksmnode *n, **np;
+  uint pa, sum;
+  pte_t *upte;
+  page_data_t *pd;
+
+  pa = PTE_ADDR(*pte);
+  pd = get_pd(pa);
+  if(pd->ksm || get_ref_pa(pa) != 1)
+    return;
+  sum = cksum(P2V(pa));
+
+  for(n = ksm.stable[sum % NKSMHASH]; n; n = n->next){
+    if(n->sum == sum && stablevalid(n) && memcmp(P2V(n->pa), P2V(pa), PGSIZE) == 0){
+      merge(pte, n->pa);
+      return;
+    }
+  }
+
+  // Volatile pages are not worth merging: wait for the next pass.
+  if(pd->cksum != sum){
+    pd->cksum = sum;
+    return;
+  }
+
+  for(np = &ksm.unstable[sum % NKSMHASH]; (n = *np) != NULL; np = &n->next){
+    if(n->sum != sum || n->pa == pa)
+      continue;
+    if((upte = unstablepte(n)) == 0 || memcmp(P2V(n->pa), P2V(pa), PGSIZE) != 0)
+      continue;
+    // Promote the candidate to a merged frame and share it.
+    *np = n->next;
+    *upte = (*upte & ~PTE_W) | PTE_C;
+    get_pd(n->pa)->ksm = TRUE;
+    n->next = ksm.stable[sum % NKSMHASH];
+    ksm.stable[sum % NKSMHASH] = n;
+    merge(pte, n->pa);
+    return;
+  }
+
+  if((n = nodealloc()) == NULL)
+    return;
+  n->pa = pa;
+  n->sum = sum;
+  n->p = p;
+  n->pid = p->pid;
+  n->va = va;
+  n->next = ksm.unstable[sum % NKSMHASH];
+  ksm.unstable[sum % NKSMHASH] = n;
+}
+
+// Drop merged frames that were freed or unmerged, recount the rest.
+static void
+ksmprune(void)
+{
+  struct ksmnode *n, **np;
+  int i;
+
+  ksm.stat.shared = ksm.stat.sharing = 0;
+  for(i = 0; i < NKSMHASH; i++){
+    for(np = &ksm.stable[i]; (n = *np) != NULL;){
+      if(!stablevalid(n)){
+        *np = n->next;
+        nodefree(n);
+        continue;
+      }
+      ksm.stat.shared++;
+      ksm.stat.sharing += get_ref_pa(n->pa);
+      np = &n->next;
+    }
+  }
+  ksm.stat.saved = ksm.stat.sharing - ksm.stat.shared;
+}
+
+static void
+endpass(void)
+{
+  struct ksmnode *n;
+  int i;
+
+  for(i = 0; i < NKSMHASH; i++){
+    while((n = ksm.unstable[i]) != NULL){
+      ksm.unstable[i] = n->next;
+      nodefree(n);
+    }
+  }
+  ksm.stat.fullscans++;
+  ksm.p = ptable.proc;
+  ksm.va = 0;
+}
+
+// Look at up to npages user pages, resuming where the last call stopped.
+static void
+ksmscan(int npages)
+{
+  struct proc *p;
+  pte_t *pte;
+  uint va;
+
+  while(npages > 0){
+    if(ksm.p == &ptable.proc[NPROC]){
+      endpass();
+      break;
+    }
+    p = ksm.p;
+    if(!scannable(p) || ksm.va >= p->sz){
+      ksm.p++;
+      ksm.va = 0;
+      continue;
+    }
+    va = ksm.va;
+    if((pte = walkpgdir(p->pgdir, (void*)va, FALSE)) == 0){
+      ksm.va = PGADDR(PDX(va) + 1, 0, 0);
+      continue;
+    }
+    ksm.va += PGSIZE;
+    npages--;
+    ksm.stat.scanned++;
+    if((*pte & (PTE_P | PTE_U)) != (PTE_P | PTE_U) || (*pte & PTE_L))
+      continue;
+    ksmpage(p, va, pte);
+  }
+  ksmprune();
+}
+
+// The ksmd kernel thread.
+void
+ksmd(void)
+{
+  int i;
+
+  acquire(&ptable.lock);
+  for(i = 0; i < NKSMPAGES; i++)
+    nodefree(&ksm.node[i]);
+  ksm.p = ptable.proc;
+  release(&ptable.lock);
+
+  for(;;){
+    acquire(&ptable.lock);
+    ksmscan(KSMSCANPAGES);
+    release(&ptable.lock);
+
+    ticksleep(KSMINTERVAL);
+  }
+}
+
+// Copy the counters to kernel memory st.
+void
+ksmgetstat(struct ksmstat *st)
+{
+  acquire(&ptable.lock);
+  *st = ksm.stat;
+  release(&ptable.lock);
+}
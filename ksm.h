@@ -0,0 +1,13 @@
+#ifndef XV6_PUBLIC_KSM_H
+#define XV6_PUBLIC_KSM_H
+
+// Same-page merging counters, returned by ksmstat().
+struct ksmstat {
+  uint scanned;     // user pages looked at by ksmd
+  uint fullscans;   // completed passes over every process
+  uint shared;      // merged frames in use
+  uint sharing;     // page table entries that map a merged frame
+  uint saved;       // frames freed by merging: sharing - shared
+};
+
+#endif //XV6_PUBLIC_KSM_H
@@ -0,0 +1,18 @@
+//
+// Print the same-page merging counters.
+//
+#include "types.h"
+#include "user.h"
+#include "ksm.h"
+
+int main(int argc, char **argv) {
+  struct ksmstat st;
+
+  if (ksmstat(&st) < 0) {
+    printf(STDERR, "ksmstat: failed\n");
+    exit();
+  }
+  printf(STDOUT, "scanned:%u\tfullscans:%u\tshared:%u\tsharing:%u\tsaved:%u\n",
+         st.scanned, st.fullscans, st.shared, st.sharing, st.saved);
+  exit();
+}
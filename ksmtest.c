@@ -0,0 +1,96 @@
+//
+// Identical heaps in several children must be merged by ksmd,
+// and a write must give the writer its own copy back.
+//
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "mmu.h"
+#include "ksm.h"
+
+#define NCHILD 4
+#define NPAGES 16
+#define TIMEOUT 200 // in KSMINTERVAL sleeps
+
+static void
+fill(char *buf) {
+  for (int i = 0; i < NPAGES; ++i)
+    for (int j = 0; j < PGSIZE; ++j)
+      buf[i * PGSIZE + j] = (char) (i * 7 + j);
+}
+
+static int
+check(char *buf, int delta) {
+  for (int i = 0; i < NPAGES; ++i)
+    for (int j = 0; j < PGSIZE; ++j)
+      if (buf[i * PGSIZE + j] != (char) (i * 7 + j + delta))
+        return -1;
+  return 0;
+}
+
+static void
+child(int ready, int go) {
+  char *buf = sbrk(NPAGES * PGSIZE);
+  char c;
+  int i;
+
+  fill(buf);
+  write(ready, "r", 1);
+  read(go, &c, 1);
+
+  if (check(buf, 0) < 0) {
+    printf(STDOUT, "ksmtest: merged data FAILED\n");
+    exit();
+  }
+  // Writes unmerge: every page becomes private again.
+  for (i = 0; i < NPAGES * PGSIZE; ++i)
+    buf[i]++;
+  if (check(buf, 1) < 0) {
+    printf(STDOUT, "ksmtest: unmerged data FAILED\n");
+    exit();
+  }
+  exit();
+}
+
+int main(int argc, char **argv) {
+  struct ksmstat before, st;
+  int ready[2], go[2];
+  int i, t;
+  char c;
+
+  if (pipe(ready) < 0 || pipe(go) < 0) {
+    printf(STDOUT, "ksmtest: pipe FAILED\n");
+    exit();
+  }
+  ksmstat(&before);
+  for (i = 0; i < NCHILD; ++i) {
+    int pid = fork();
+    if (pid < 0) {
+      printf(STDOUT, "ksmtest: fork FAILED\n");
+      exit();
+    }
+    if (pid == 0)
+      child(ready[1], go[0]);
+  }
+  for (i = 0; i < NCHILD; ++i)
+    read(ready[0], &c, 1);
+
+  for (t = 0; t < TIMEOUT; ++t) {
+    sleep(KSMINTERVAL);
+    ksmstat(&st);
+    if (st.saved - before.saved >= (NCHILD - 1) * NPAGES)
+      break;
+  }
+  printf(STDOUT, "after %d ticks: scanned:%u\tshared:%u\tsharing:%u\tsaved:%u\n",
+         t * KSMINTERVAL, st.scanned - before.scanned, st.shared, st.sharing, st.saved);
+  if (t == TIMEOUT)
+    printf(STDOUT, "ksmtest: merging FAILED\n");
+
+  for (i = 0; i < NCHILD; ++i)
+    write(go[1], "g", 1);
+  for (i = 0; i < NCHILD; ++i)
+    wait();
+
+  printf(STDOUT, "ksmtest OK\n");
+  exit();
+}
@@ -32,6 +32,7 @@
 #define TIMER   (0x0320/4)   // Local Vector Table 0 (TIMER)
   #define X1         0x0000000B   // divide counts by 1
   #define PERIODIC   0x00020000   // Periodic
+  #define ONESHOT    0x00000000   // One-shot
 #define PCINT   (0x0340/4)   // Performance Counter LVT
 #define LINT0   (0x0350/4)   // Local Vector Table 1 (LINT0)
 #define LINT1   (0x0360/4)   // Local Vector Table 2 (LINT1)
@@ -62,12 +63,12 @@ lapicinit(void)
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-  // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // The timer counts down once at bus frequency from lapic[TICR]
+  // and then issues an interrupt. timer.c calibrates it against
+  // the PIT and re-arms it for the next deadline on every interrupt;
+  // this first count only gets it going.
   lapicw(TDCR, X1);
-  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TIMER, ONESHOT | (T_IRQ0 + IRQ_TIMER));
   lapicw(TICR, 10000000);
 
 //  lapicw(SWP, PERIODIC | (T_IRQ0 + IRQ_SWAP));
@@ -116,6 +117,32 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Start a one-shot countdown of count bus cycles; 0 stops the timer.
+void
+lapiconeshot(uint count)
+{
+  if(lapic)
+    lapicw(TICR, count);
+}
+
+uint
+lapiccount(void)
+{
+  return lapic ? lapic[TCCR] : 0;
+}
+
+// Send interrupt vector to the CPU with the given APIC ID.
+void
+lapicipi(int apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
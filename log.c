@@ -1,6 +1,8 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
+#include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
@@ -9,16 +11,36 @@
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
-// any reasoning required about whether a commit might
-// write an uncommitted system call's updates to disk.
+// calls. A transaction is only closed when there are no FS
+// system calls active in it. Thus there is never any reasoning
+// required about whether a commit might write an uncommitted
+// system call's updates to disk.
 //
-// A system call should call begin_op()/end_op() to mark
-// its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// A system call should call begin_op(n)/end_op() to mark
+// its start and end, n being the most log blocks it will
+// change. Usually begin_op() just reserves them and returns.
+// But if the log has no room for them next to what is logged
+// and what the other in-progress FS system calls reserved, it
+// sleeps until they end or logd has made room. log_write()
+// takes a new slot out of the caller's reservation, and
+// end_op() returns what is left of it.
+//
+// An FS op can start inside another one of the same process: a
+// page fault on the user buffer writei() copies from swaps the page
+// in, and that writes the swap file. The outer op keeps the running
+// transaction open, so the inner one joins it without waiting for
+// logd or for room; waiting would deadlock. Its blocks are added to
+// the outer op's reservation as far as the log has room, and come
+// out of the NESTOPBLOCKS every op reserves on top of its own for
+// this otherwise. The outermost end_op() returns what is left.
+//
+// The logd kernel thread commits for everybody (group commit).
+// When the running transaction has updates, logd holds off new
+// system calls until the active ones end, copies the transaction's
+// blocks into log buffers and queues their writes, and lets the next
+// transaction start filling while it waits for the writes and then
+// writes the header. end_op() does not wait for any of it; fsync()
+// waits for the commit.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -27,7 +49,18 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// mkfs sizes the log; the superblock records it.
+//
+// Installing is lazy. A commit leaves its blocks in the log and dirty
+// in the buffer cache, and the next transaction appends after them.
+// The log is checkpointed -- the committed blocks written to their
+// home locations in block order, each once however many transactions
+// changed it, and the log cleared -- when it gets too full for another
+// transaction, by the flushd kernel thread once FLUSHTICKS pass, or by
+// sync(). A block changed again after its transaction closed gets a
+// new slot, so that a crash before the next commit still recovers the
+// committed contents; recovery installs the slots in order, so the
+// last wins.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -39,16 +72,27 @@ struct logheader {
 struct log {
   struct spinlock lock;
   int start;
-  int size;
-  int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int size;        // blocks, the header included
+  int outstanding; // how many FS sys calls are executing,
+  int reserved;    // log blocks they may still add.
+  int need;        // Largest reservation waiting for a checkpoint.
+  int sealing;     // logd waits for them to end, please wait.
+  int sealed;      // lh.block[0..sealed) are in closed transactions,
+  int committed;   // lh.block[0..committed) in committed ones.
+  int flushreq;    // logflush() waits for a checkpoint.
+  int installing;  // logd checkpoints after this commit.
+  uint nseal;      // transactions closed,
+  uint ncommit;    // committed,
+  uint ninstall;   // and checkpoints done so far.
   int dev;
   struct logheader lh;
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void logd(void);
+static void flushd(void);
+static void checkpoint(void);
 
 void
 initlog(int dev)
@@ -61,11 +105,19 @@ initlog(int dev)
   readsb(dev, &sb);
   log.start = sb.logstart;
   log.size = sb.nlog;
+  if (log.size - 1 > LOGSIZE || log.size - 1 < MAXWRITEBLOCKS * 2)
+    panic("initlog: bad log size");
   log.dev = dev;
   recover_from_log();
+  // Only now: before recovery they would commit and checkpoint
+  // a log that is not there, or write over the one being recovered.
+  kthread_create("logd", logd);     // log commits
+  kthread_create("flushd", flushd); // log checkpoints
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location,
+// in log order. Only recovery needs this: otherwise the
+// cached blocks are up to date, see checkpoint().
 static void
 install_trans(void)
 {
@@ -88,24 +140,26 @@ read_head(void)
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *lh = (struct logheader *) (buf->data);
   int i;
+  acquire(&log.lock);
   log.lh.n = lh->n;
   for (i = 0; i < log.lh.n; i++) {
     log.lh.block[i] = lh->block[i];
   }
+  release(&log.lock);
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
+// Write the in-memory log header of slots [0, n) to disk.
 // This is the true point at which the
-// current transaction commits.
+// transactions in them commit.
 static void
-write_head(void)
+write_head(int n)
 {
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
+  hb->n = n;
+  for (i = 0; i < n; i++) {
     hb->block[i] = log.lh.block[i];
   }
   bwrite(buf);
@@ -117,23 +171,61 @@ recover_from_log(void)
 {
   read_head();
   install_trans(); // if committed, copy from log to disk
+  acquire(&log.lock);
   log.lh.n = 0;
-  write_head(); // clear the log
+  release(&log.lock);
+  write_head(0); // clear the log
 }
 
-// called at the start of each FS system call.
+// Would the largest waiting operation, or a metadata
+// one, overflow the log?
+static int
+logfull(void)
+{
+  int n = log.need > MAXOPBLOCKS + NESTOPBLOCKS ? log.need : MAXOPBLOCKS + NESTOPBLOCKS;
+
+  return log.lh.n + n > log.size - 1;
+}
+
+// called at the start of each FS system call that
+// changes at most n blocks.
 void
-begin_op(void)
+begin_op(int n)
 {
+  struct proc *p = myproc();
+  int room;
+
   acquire(&log.lock);
+  if(p->logdepth > 0){
+    // nested: join the transaction the outer op holds open.
+    room = log.size - 1 - log.lh.n - log.reserved;
+    if(n > room)
+      n = room > 0 ? room : 0;
+    log.reserved += n;
+    p->logres += n;
+    p->logdepth++;
+    release(&log.lock);
+    return;
+  }
+
+  n += NESTOPBLOCKS;
+  if(n > log.size - 1)
+    panic("begin_op: too big a reservation");
   while(1){
-    if(log.committing){
+    if(log.sealing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
+    } else if(log.lh.n + log.reserved + n > log.size - 1){
+      // this op might exhaust log space; wait for the others
+      // to end, or for logd to checkpoint.
+      if(n > log.need)
+        log.need = n;
+      wakeup(&log.lh);
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      p->logres = n;
+      p->logdepth = 1;
       release(&log.lock);
       break;
     }
@@ -141,69 +233,185 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// logd commits once the last outstanding operation ends.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
-  log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
-  }
-  release(&log.lock);
-
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
+  if(--myproc()->logdepth > 0){
+    // nested: the outer op keeps the reservation.
     release(&log.lock);
+    return;
   }
+  log.outstanding -= 1;
+  if(log.outstanding < 0)
+    panic("end_op");
+  log.reserved -= myproc()->logres;
+  myproc()->logres = 0;
+  if(log.outstanding == 0)
+    wakeup(&log.lh);
+  // begin_op() may be waiting for log space,
+  // and what is left of our reservation is free again.
+  wakeup(&log);
+  release(&log.lock);
 }
 
-// Copy modified blocks from cache to log.
+// Copy the blocks of slots [first, end) from cache to log buffers,
+// and queue the writes of the log buffers.
 static void
-write_log(void)
+write_log(int first, int end)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
+  for (tail = first; tail < end; tail++) {
     struct buf *to = bread(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    bawrite(to);  // write the log
     brelse(from);
-    brelse(to);
   }
 }
 
+// The logd kernel thread.
 static void
-commit()
+logd(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  int from, to, tail, install;
+
+  for (;;) {
+    acquire(&log.lock);
+    while (log.lh.n == log.sealed && !log.flushreq && !logfull())
+      sleep(&log.lh, &log.lock);
+    // Close the running transaction.
+    log.sealing = 1;
+    while (log.outstanding > 0)
+      sleep(&log.lh, &log.lock);
+    from = log.sealed;
+    to = log.lh.n;
+    release(&log.lock);
+
+    write_log(from, to);
+
+    acquire(&log.lock);
+    log.sealed = to;
+    if (from < to)
+      log.nseal++;
+    // A checkpoint needs the cache to hold exactly what was
+    // committed: keep new transactions out until it is done.
+    install = log.installing = log.flushreq || logfull();
+    log.flushreq = 0;
+    if (!install) {
+      log.sealing = 0;
+      wakeup(&log);
+    }
+    release(&log.lock);
+
+    if (from < to) {
+      // bread() waits for the write that holds the buffer.
+      for (tail = from; tail < to; tail++)
+        brelse(bread(log.dev, log.start+tail+1));
+      write_head(to);    // Write header to disk -- the real commit
+    }
+    acquire(&log.lock);
+    log.committed = to;
+    if (from < to)
+      log.ncommit++;
+    release(&log.lock);
+
+    if (install)
+      checkpoint();
+
+    acquire(&log.lock);
+    if (install) {
+      log.ninstall++;
+      log.installing = 0;
+      log.sealing = 0;
+      log.need = 0;  // the waiters retry, and say again
+      wakeup(&log);
+    }
+    wakeup(&log.ncommit);
+    release(&log.lock);
+  }
+}
+
+// Write the committed blocks to their home locations and clear the
+// log. Runs with every transaction committed and none open, so the
+// cached blocks hold exactly what was committed. The writes are queued
+// in block order, so that the disk seeks one way, before waiting for
+// any of them.
+static void
+checkpoint(void)
+{
+  static uint blocks[LOGSIZE];  // only logd comes here
+  int i, j, n = 0;
+
+  if (log.lh.n == 0)
+    return;
+  // Sort the block numbers, dropping duplicates.
+  for (i = 0; i < log.lh.n; i++) {
+    for (j = 0; j < n && blocks[j] < log.lh.block[i]; j++)
+      ;
+    if (j < n && blocks[j] == log.lh.block[i])
+      continue;
+    memmove(&blocks[j+1], &blocks[j], (n - j) * sizeof(blocks[0]));
+    blocks[j] = log.lh.block[i];
+    n++;
+  }
+  for (i = 0; i < n; i++)
+    bawrite(bread(log.dev, blocks[i]));
+  for (i = 0; i < n; i++)
+    brelse(bread(log.dev, blocks[i]));
+  log.lh.n = log.sealed = log.committed = 0;
+  write_head(0);    // Erase the installed transactions from the log
+}
+
+// Wait until everything done so far is committed.
+void
+logcommit(void)
+{
+  uint target;
+
+  acquire(&log.lock);
+  if (log.lh.n > log.committed) {
+    // The running transaction, if it has updates, is the next closed.
+    target = log.nseal + (log.lh.n > log.sealed);
+    wakeup(&log.lh);
+    while ((int)(log.ncommit - target) < 0)
+      sleep(&log.ncommit, &log.lock);
+  }
+  release(&log.lock);
+}
+
+// Wait until everything done so far is committed and installed.
+void
+logflush(void)
+{
+  uint target;
+
+  acquire(&log.lock);
+  target = log.ninstall + 1;
+  log.flushreq = 1;
+  wakeup(&log.lh);
+  while ((int)(log.ninstall - target) < 0)
+    sleep(&log.ncommit, &log.lock);
+  release(&log.lock);
+}
+
+// The flushd kernel thread: installs committed transactions
+// that have not been installed for FLUSHTICKS.
+static void
+flushd(void)
+{
+  for (;;) {
+    ticksleep(FLUSHTICKS);
+    if (log.lh.n > 0)
+      logflush();
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache with B_DIRTY.
-// commit()/write_log() will do the disk write.
+// logd's write_log() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -213,21 +421,25 @@ commit()
 void
 log_write(struct buf *b)
 {
+  struct proc *p = myproc();
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
-    panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
   acquire(&log.lock);
-  for (i = 0; i < log.lh.n; i++) {
+  for (i = log.sealed; i < log.lh.n; i++) {
     if (log.lh.block[i] == b->blockno)   // log absorbtion
       break;
   }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n)
+  if (i == log.lh.n) {
+    if (p->logres < 1 || log.lh.n >= log.size - 1)
+      panic("too big a transaction");
+    p->logres--;
+    log.reserved--;
     log.lh.n++;
+  }
+  log.lh.block[i] = b->blockno;
   b->flags |= B_DIRTY; // prevent eviction
   release(&log.lock);
 }
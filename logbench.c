@@ -0,0 +1,90 @@
+//
+// Concurrent small-file writes: 1, 2, 4 and 8 processes each create,
+// write and close their own files, then remove them. With every
+// operation reserving only the log blocks it needs, throughput should
+// keep rising with the processes until the disk or the CPUs saturate,
+// not stop at the few transactions that used to fit in the log.
+// usage: logbench [files] [size]
+//
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "date.h"
+
+#define MAXPROCS 8
+
+static char buf[2048];
+
+static void
+writes(int p, int nfiles, int size) {
+  char path[16];
+  int fd, i;
+
+  for (i = 0; i < nfiles; ++i) {
+    benchname(path, "lb", p, i);
+    if ((fd = open(path, O_CREATE | O_RDWR)) < 0) {
+      printf(STDERR, "logbench: cannot create %s\n", path);
+      exit();
+    }
+    if (write(fd, buf, size) != size) {
+      printf(STDERR, "logbench: write failed\n");
+      exit();
+    }
+    close(fd);
+  }
+}
+
+// Return files written per second by nprocs processes.
+static uint
+run(int nprocs, int nfiles, int size) {
+  struct timespec t0, t1;
+  char path[16];
+  uint t;
+  int p, i;
+
+  sync();
+  monotime(&t0);
+  for (p = 0; p < nprocs; ++p) {
+    if (fork() == 0) {
+      writes(p, nfiles, size);
+      exit();
+    }
+  }
+  for (p = 0; p < nprocs; ++p)
+    wait();
+  monotime(&t1);
+
+  for (p = 0; p < nprocs; ++p) {
+    for (i = 0; i < nfiles; ++i) {
+      benchname(path, "lb", p, i);
+      unlink(path);
+    }
+  }
+
+  t = elapsedms(&t0, &t1);
+  return t ? nprocs * nfiles * 1000 / t : 0;
+}
+
+int main(int argc, char **argv) {
+  int nfiles, size, nprocs;
+  uint one = 0, rate;
+
+  nfiles = argc > 1 ? atoi(argv[1]) : 20;
+  size = argc > 2 ? atoi(argv[2]) : 100;
+  if (nfiles < 1 || size < 1 || size > sizeof(buf)) {
+    printf(STDERR, "usage: logbench [files] [size]\n");
+    exit();
+  }
+  memset(buf, 'l', sizeof(buf));
+
+  printf(STDOUT, "logbench: %d files of %d bytes per process\n", nfiles, size);
+  for (nprocs = 1; nprocs <= MAXPROCS; nprocs *= 2) {
+    rate = run(nprocs, nfiles, size);
+    if (nprocs == 1)
+      one = rate;
+    printf(STDOUT, "%d procs: %d files/s, %d.%dx one\n", nprocs, rate,
+           one ? rate / one : 0, one ? rate * 10 / one % 10 : 0);
+  }
+  exit();
+}
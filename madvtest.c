@@ -0,0 +1,138 @@
+//
+// madvise() hints: prefault, drop and swap readahead by access pattern.
+//
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "stateinfo.h"
+#include "mman.h"
+#include "mmu.h"
+
+#define NPAGES 64
+
+struct procinfo *pi_arr;
+struct cpuinfo *cpui_arr;
+
+// Fetch this process' entry from state().
+static struct procinfo *
+self(void) {
+  int pid = getpid();
+
+  if (state(&pi_arr, &cpui_arr) < 0)
+    return 0;
+  for (int i = 0; i < NPROC; ++i)
+    if (pi_arr[i].pid == pid)
+      return &pi_arr[i];
+  return 0;
+}
+
+static void
+fail(char *msg) {
+  printf(STDOUT, "madvtest: %s FAILED\n", msg);
+  exit();
+}
+
+// Tag buf with advice, push it out to swap and count the swap-in
+// faults taken reading it back.
+static uint
+swapins(char *buf, int advice) {
+  uint faults;
+  int i;
+
+  for (i = 0; i < NPAGES; ++i)
+    buf[i * PGSIZE] = i;
+  if (madvise(buf, NPAGES * PGSIZE, advice) < 0)
+    fail("advice");
+  // two passes: the first clears PTE_A, the second evicts
+  swap();
+  swap();
+  faults = self()->majflt;
+  for (i = 0; i < NPAGES; ++i)
+    if (buf[i * PGSIZE] != (char) i)
+      fail("swapped data");
+  return self()->majflt - faults;
+}
+
+int main(int argc, char **argv) {
+  struct procinfo *me;
+  uint faults, rss;
+  char *buf;
+  int i;
+
+  pi_arr = malloc(NPROC * sizeof(struct procinfo));
+  cpui_arr = malloc(NCPU * sizeof(struct cpuinfo));
+  // self() touches the state buffers; fault them in before measuring
+  if ((me = self()) == 0)
+    fail("state");
+
+  buf = sbrk(NPAGES * PGSIZE);
+  if (madvise(buf + 1, PGSIZE, MADV_WILLNEED) == 0)
+    fail("unaligned address");
+  if (madvise(buf, PGSIZE, 42) == 0)
+    fail("bad advice");
+  // the page below the stack is exec()'s guard; dropping it would
+  // turn a stack overflow into a fresh zero page
+  if (madvise((char *) PGROUNDDOWN((uint) &i) - PGSIZE, PGSIZE, MADV_DONTNEED) == 0)
+    fail("dontneed on the stack guard page");
+
+  // WILLNEED maps the whole range up front: no faults on first touch.
+  me = self();
+  rss = me->resident;
+  if (madvise(buf, NPAGES * PGSIZE, MADV_WILLNEED) < 0)
+    fail("willneed");
+  me = self();
+  if (me->resident - rss < NPAGES * PGSIZE)
+    fail("willneed rss");
+  faults = me->minflt;
+  for (i = 0; i < NPAGES; ++i)
+    buf[i * PGSIZE] = i;
+  me = self();
+  if (me->minflt != faults)
+    fail("willneed faults");
+  printf(STDOUT, "willneed: %d pages resident, %d faults on touch\n",
+         NPAGES, me->minflt - faults);
+
+  // DONTNEED drops the pages; the next touch sees zeroes.
+  rss = me->resident;
+  if (madvise(buf, NPAGES * PGSIZE, MADV_DONTNEED) < 0)
+    fail("dontneed");
+  me = self();
+  if (rss - me->resident < NPAGES * PGSIZE)
+    fail("dontneed rss");
+  for (i = 0; i < NPAGES; ++i)
+    if (buf[i * PGSIZE] != 0)
+      fail("dontneed zero");
+  printf(STDOUT, "dontneed: released %d bytes\n", rss - me->resident);
+
+  // SEQUENTIAL pages are evicted on the first swap() and come back
+  // SWAPREADAHEAD at a time.
+  for (i = 0; i < NPAGES; ++i)
+    buf[i * PGSIZE] = i;
+  if (madvise(buf, NPAGES * PGSIZE, MADV_SEQUENTIAL) < 0)
+    fail("sequential");
+  swap();
+  me = self();
+  faults = me->majflt;
+  for (i = 0; i < NPAGES; ++i)
+    if (buf[i * PGSIZE] != (char) i)
+      fail("sequential data");
+  me = self();
+  printf(STDOUT, "sequential: %d swap-in faults for %d pages\n",
+         me->majflt - faults, NPAGES);
+  if (me->majflt - faults >= NPAGES)
+    fail("sequential readahead");
+
+  // NORMAL reads SWAPCLUSTER pages ahead; RANDOM reads none, one
+  // fault per page.
+  faults = swapins(buf, MADV_NORMAL);
+  i = swapins(buf, MADV_RANDOM);
+  printf(STDOUT, "normal: %d swap-in faults, random: %d, for %d pages\n",
+         faults, i, NPAGES);
+  if (i <= faults)
+    fail("random readahead");
+
+  if (madvise(buf, NPAGES * PGSIZE, MADV_NORMAL) < 0)
+    fail("normal");
+  printf(STDOUT, "madvtest OK\n");
+  exit();
+}
@@ -27,7 +27,9 @@ main(void)
   ioapicinit();    // another interrupt controller
   consoleinit();   // console hardware
   uartinit();      // serial port
+  timerinit();     // calibrate TSC and LAPIC timer
   pinit();         // process table
+  futexinit();     // futex wait queues
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
@@ -35,6 +37,8 @@ main(void)
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
   userinit();      // first user process
+  kthread_create("ksmd", ksmd); // same-page merging
+  kthread_create("kidled", kidled); // working-set sampling
   mpmain();        // finish this processor's setup
 }
 
@@ -17,6 +17,7 @@ extern uchar _binary_fs_img_start[], _binary_fs_img_size[];
 
 static int disksize;
 static uchar *memdisk;
+static uint requests;
 
 void
 ideinit(void)
@@ -50,6 +51,7 @@ iderw(struct buf *b)
     panic("iderw: block out of range");
 
   p = memdisk + b->blockno*BSIZE;
+  requests++;
 
   if(b->flags & B_DIRTY){
     b->flags &= ~B_DIRTY;
@@ -57,4 +59,12 @@ iderw(struct buf *b)
   } else
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
+  if(b->flags & B_ASYNC)
+    bdone(b);
+}
+
+uint
+iderequests(void)
+{
+  return requests;
 }
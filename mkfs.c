@@ -23,7 +23,7 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGSIZE + 1;  // header + data blocks, mkfs -l to change
 int nswap = (PGSIZE/BSIZE) * NPROC;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
@@ -69,7 +69,7 @@ xint(uint x)
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
+  int i, cc, fd, argi = 1;
   uint rootino, inum, off;
   struct dirent de;
   char buf[BSIZE];
@@ -78,17 +78,26 @@ main(int argc, char *argv[])
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
-  if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+  if(argc > 2 && strcmp(argv[1], "-l") == 0){
+    nlog = atoi(argv[2]);
+    argi = 3;
+  }
+  if(argc < argi + 1){
+    fprintf(stderr, "Usage: mkfs [-l logblocks] fs.img files...\n");
+    exit(1);
+  }
+  if(nlog - 1 < MAXWRITEBLOCKS * 2 || nlog - 1 > LOGSIZE){
+    fprintf(stderr, "mkfs: log must be %d to %d blocks\n",
+            MAXWRITEBLOCKS * 2 + 1, LOGSIZE + 1);
     exit(1);
   }
 
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
 
-  fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
+  fsfd = open(argv[argi], O_RDWR|O_CREAT|O_TRUNC, 0666);
   if(fsfd < 0){
-    perror(argv[1]);
+    perror(argv[argi]);
     exit(1);
   }
 
@@ -105,6 +114,7 @@ main(int argc, char *argv[])
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
   sb.swapstart = xint(2+nlog+ninodeblocks+nbitmap);
+  sb.bsize = xint(BSIZE);
 
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u swap blocks %u) blocks %d total %d\n",
@@ -132,7 +142,7 @@ main(int argc, char *argv[])
   strcpy(de.name, "..");
   iappend(rootino, &de, sizeof(de));
 
-  for(i = 2; i < argc; i++){
+  for(i = argi + 1; i < argc; i++){
     assert(index(argv[i], '/') == 0);
 
     if((fd = open(argv[i], 0)) < 0){
@@ -235,6 +245,8 @@ ialloc(ushort type)
   din.type = xshort(type);
   din.nlink = xshort(1);
   din.size = xint(0);
+  if(type == T_FILE)
+    din.flags = xint(I_EXTENTS);
   winode(inum, &din);
   return inum;
 }
@@ -261,11 +273,13 @@ void
 iappend(uint inum, void *xp, int n)
 {
   char *p = (char*)xp;
-  uint fbn, off, n1;
+  uint fbn, dbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
   uint indirect[NINDIRECT];
-  uint x;
+  struct extent *ext;
+  uint x, b;
+  int i;
 
   rinode(inum, &din);
   off = xint(din.size);
@@ -273,21 +287,58 @@ iappend(uint inum, void *xp, int n)
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
+    if(xint(din.flags) & I_EXTENTS){
+      ext = (struct extent*)din.addrs;
+      x = 0;
+      for(i = 0, b = 0; i < NIEXTENT && ext[i].len; i++){
+        if(fbn >= b && fbn < b + xint(ext[i].len))
+          x = xint(ext[i].start) + fbn - b;
+        b += xint(ext[i].len);
+      }
+      if(x == 0){
+        // A new block. Files are written one at a time, so it
+        // mostly extends the last extent.
+        x = freeblock++;
+        if(i > 0 && xint(ext[i-1].start) + xint(ext[i-1].len) == x){
+          ext[i-1].len = xint(xint(ext[i-1].len) + 1);
+        } else {
+          assert(i < NIEXTENT);
+          ext[i].start = xint(x);
+          ext[i].len = xint(1);
+        }
+      }
+    } else if(fbn < NDIRECT){
       if(xint(din.addrs[fbn]) == 0){
         din.addrs[fbn] = xint(freeblock++);
       }
       x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
+    } else if(fbn < NDIRECT + NINDIRECT){
+      if(xint(din.addrs[IND_BLOCK]) == 0){
+        din.addrs[IND_BLOCK] = xint(freeblock++);
       }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
+      rsect(xint(din.addrs[IND_BLOCK]), (char*)indirect);
       if(indirect[fbn - NDIRECT] == 0){
         indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
+        wsect(xint(din.addrs[IND_BLOCK]), (char*)indirect);
       }
       x = xint(indirect[fbn-NDIRECT]);
+    } else {
+      dbn = fbn - NDIRECT - NINDIRECT;
+      if(xint(din.addrs[DIND_BLOCK]) == 0){
+        din.addrs[DIND_BLOCK] = xint(freeblock++);
+      }
+      rsect(xint(din.addrs[DIND_BLOCK]), (char*)indirect);
+      if(indirect[dbn / NINDIRECT] == 0){
+        indirect[dbn / NINDIRECT] = xint(freeblock++);
+        wsect(xint(din.addrs[DIND_BLOCK]), (char*)indirect);
+      }
+      x = xint(indirect[dbn / NINDIRECT]);
+      rsect(x, (char*)indirect);
+      if(indirect[dbn % NINDIRECT] == 0){
+        indirect[dbn % NINDIRECT] = xint(freeblock++);
+        wsect(x, (char*)indirect);
+      }
+      x = xint(indirect[dbn % NINDIRECT]);
     }
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
@@ -0,0 +1,107 @@
+//
+// mlock()/munlock()/mlockall(): locked pages must survive swap().
+//
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "stateinfo.h"
+#include "mman.h"
+#include "mmu.h"
+
+#define NPAGES 32
+
+struct procinfo *pi_arr;
+struct cpuinfo *cpui_arr;
+
+static struct procinfo *
+self(void) {
+  int pid = getpid();
+
+  if (state(&pi_arr, &cpui_arr) < 0)
+    return 0;
+  for (int i = 0; i < NPROC; ++i)
+    if (pi_arr[i].pid == pid)
+      return &pi_arr[i];
+  return 0;
+}
+
+static void
+fail(char *msg) {
+  printf(STDOUT, "mlocktest: %s FAILED\n", msg);
+  exit();
+}
+
+// Two passes: the first clears PTE_A, the second evicts.
+static void
+evict(void) {
+  swap();
+  swap();
+}
+
+int main(int argc, char **argv) {
+  struct procinfo *me;
+  uint faults;
+  char *buf;
+  int i;
+
+  pi_arr = malloc(NPROC * sizeof(struct procinfo));
+  cpui_arr = malloc(NCPU * sizeof(struct cpuinfo));
+  if (self() == 0)
+    fail("state");
+
+  buf = sbrk(NPAGES * PGSIZE);
+  if (mlock(buf, NPAGES * PGSIZE) < 0)
+    fail("mlock");
+  me = self();
+  if (me->locked != NPAGES * PGSIZE)
+    fail("locked size");
+  for (i = 0; i < NPAGES; ++i)
+    buf[i * PGSIZE] = i;
+
+  // Locked pages stay resident: touching them again costs no faults.
+  evict();
+  faults = self()->majflt;
+  for (i = 0; i < NPAGES; ++i)
+    if (buf[i * PGSIZE] != (char) i)
+      fail("locked data");
+  me = self();
+  if (me->majflt != faults)
+    fail("locked pages were swapped");
+  printf(STDOUT, "locked: %d bytes, %d swap-in faults after swap\n",
+         me->locked, me->majflt - faults);
+
+  if (madvise(buf, PGSIZE, MADV_DONTNEED) == 0)
+    fail("dontneed on locked page");
+  if (mlock(buf, (MLOCKLIMIT + 1) * PGSIZE) == 0)
+    fail("limit");
+
+  // Unlocked pages go back to normal reclaim.
+  if (munlock(buf, NPAGES * PGSIZE) < 0)
+    fail("munlock");
+  if (self()->locked != 0)
+    fail("unlocked size");
+  evict();
+  faults = self()->majflt;
+  for (i = 0; i < NPAGES; ++i)
+    if (buf[i * PGSIZE] != (char) i)
+      fail("unlocked data");
+  me = self();
+  printf(STDOUT, "unlocked: %d swap-in faults after swap\n", me->majflt - faults);
+  if (me->majflt == faults)
+    fail("unlocked pages stayed resident");
+
+  // MCL_FUTURE locks heap pages as they are faulted in.
+  if (mlockall(MCL_FUTURE) < 0)
+    fail("mlockall");
+  buf = sbrk(NPAGES * PGSIZE);
+  for (i = 0; i < NPAGES; ++i)
+    buf[i * PGSIZE] = i;
+  me = self();
+  if (me->locked < NPAGES * PGSIZE)
+    fail("mcl_future");
+  if (munlockall() < 0 || self()->locked != 0)
+    fail("munlockall");
+
+  printf(STDOUT, "mlocktest OK\n");
+  exit();
+}
@@ -0,0 +1,15 @@
+#ifndef XV6_PUBLIC_MMAN_H
+#define XV6_PUBLIC_MMAN_H
+
+// madvise() hints, shared by the kernel and user programs.
+#define MADV_NORMAL     0   // read ahead a little on swap-in
+#define MADV_RANDOM     1   // no swap readahead
+#define MADV_SEQUENTIAL 2   // read ahead on swap-in, evict without a second chance
+#define MADV_WILLNEED   3   // prefault the range now
+#define MADV_DONTNEED   4   // drop the range; next touch gets a zero page
+
+// mlockall() flags
+#define MCL_CURRENT     1   // lock every page mapped now
+#define MCL_FUTURE      2   // lock pages as they are faulted in
+
+#endif //XV6_PUBLIC_MMAN_H
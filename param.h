@@ -7,8 +7,32 @@
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
-#define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       128*128  // size of file system in blocks 256Mb
+#define MAXOPBLOCKS  10  // max # of blocks a metadata FS op writes
+#define NESTOPBLOCKS  8  // more log blocks an FS op keeps for ops nested in it
+#define LOGSIZE     126  // max data blocks in on-disk log, the header fits a block
+#define MAXWRITEBLOCKS 16  // most data blocks one write transaction covers
+#define EXTRUNBLOCKS 16  // free blocks a new extent leaves before it and reserves after
+#define NBUF       1024  // most buffers the disk block cache grows to
+#define RAMINBLOCKS   4  // first read-ahead window of a sequential reader
+#define RAMAXBLOCKS  32  // widest read-ahead window
+#define FLUSHTICKS  300  // ticks committed blocks may wait to be installed
+#define FSSIZE     8192  // size of file system in blocks, 32MB
 //#define SWAPSIZE     1000 // in ms
+#define NMADVISE      8  // madvise() regions per process
+#define SWAPREADAHEAD 4  // pages restored after a fault in a MADV_SEQUENTIAL region
+#define SWAPCLUSTER   1  // pages restored after a fault in a MADV_NORMAL region
+#define MLOCKLIMIT  256  // max mlock()ed pages per process
+#define NVMLOCK      16  // page table locks for shared address spaces, hashed by pgdir
+#define NKSMPAGES   512  // merged + candidate pages tracked by ksmd
+#define KSMSCANPAGES 64  // pages ksmd looks at per wakeup
+#define KSMINTERVAL  10  // ticks ksmd sleeps between scans
+#define IDLEINTERVAL 100 // default ticks between kidled samples
+#define NWSSWIN       4  // working-set windows of 1, 2, 4, 8 samples
+#define PRIO_MIN    (-20) // best nice value
+#define PRIO_MAX     19  // worst nice value
+#define NPRIO        (PRIO_MAX - PRIO_MIN + 1)  // run queue levels
+#define AGETICKS      5  // ticks waited before a runnable proc moves up a level
+#define SCHED_FAIR    0  // scheduling class: vruntime, CPU share by nice weight
+#define SCHED_PRIO    1  // scheduling class: strict nice levels, above SCHED_FAIR
+#define HZ          100  // scheduler ticks per second
+#define GANGTICKS     5  // ticks a co-scheduled gang runs first everywhere
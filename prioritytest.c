@@ -0,0 +1,89 @@
+//
+// A nice -20 process must finish its work as fast with nice 19 CPU
+// hogs running on every CPU as it does on an idle machine.
+//
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "stateinfo.h"
+
+#define WORK 20000000
+#define HOGS_PER_CPU 2
+
+static int
+timed_work(void) {
+  volatile uint x = 0;
+  int start = uptime();
+
+  for (int i = 0; i < WORK; ++i)
+    x += i;
+  return uptime() - start;
+}
+
+// Run timed_work() at nice -20 in a child; return its duration in ticks.
+static int
+measure(void) {
+  int fd[2], ticks = -1;
+
+  pipe(fd);
+  if (fork() == 0) {
+    setpriority(0, PRIO_MIN);
+    ticks = timed_work();
+    write(fd[1], &ticks, sizeof(ticks));
+    exit();
+  }
+  read(fd[0], &ticks, sizeof(ticks));
+  wait();
+  close(fd[0]);
+  close(fd[1]);
+  return ticks;
+}
+
+int main(int argc, char **argv) {
+  struct procinfo *pi_arr = malloc(NPROC * sizeof(struct procinfo));
+  struct cpuinfo *cpui_arr = malloc(NCPU * sizeof(struct cpuinfo));
+  int ncpu, nhogs, alone, loaded, nice_val, i;
+  int hogs[NCPU * HOGS_PER_CPU];
+
+  if ((ncpu = state(&pi_arr, &cpui_arr)) < 0) {
+    printf(STDOUT, "prioritytest: state FAILED\n");
+    exit();
+  }
+
+  if (setpriority(0, 5) < 0 || getpriority(0, &nice_val) < 0 || nice_val != 5)
+    printf(STDOUT, "prioritytest: setpriority FAILED\n");
+  if (nice(-3) != 2)
+    printf(STDOUT, "prioritytest: nice FAILED\n");
+  setpriority(0, 100);
+  getpriority(0, &nice_val);
+  if (nice_val != PRIO_MAX)
+    printf(STDOUT, "prioritytest: clamp FAILED\n");
+  setpriority(0, 0);
+
+  alone = measure();
+
+  nhogs = ncpu * HOGS_PER_CPU;
+  for (i = 0; i < nhogs; ++i) {
+    if ((hogs[i] = fork()) == 0) {
+      setpriority(0, PRIO_MAX);
+      for (;;)
+        ;
+    }
+  }
+  sleep(10);  // let the hogs spread over the CPUs
+  loaded = measure();
+
+  for (i = 0; i < nhogs; ++i)
+    kill(hogs[i]);
+  for (i = 0; i < nhogs; ++i)
+    wait();
+
+  printf(STDOUT, "prioritytest: alone %d ticks, with %d nice %d hogs %d ticks\n",
+         alone, nhogs, PRIO_MAX, loaded);
+  // allow a tick of scheduling latency per 10 ticks of work, plus slack
+  if (loaded > alone + alone / 10 + 2)
+    printf(STDOUT, "prioritytest: FAILED\n");
+  else
+    printf(STDOUT, "prioritytest OK\n");
+  exit();
+}
@@ -4,6 +4,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
+#include "traps.h"
 #include "proc.h"
 #include "spinlock.h"
 
@@ -13,6 +14,7 @@
 #include "stateinfo.h"
 #include "debug.h"
 #include "swap.h"
+#include "rbtree.h"
 
 struct {
   struct spinlock lock;
@@ -27,10 +29,531 @@ extern void trapret(void);
 
 static void wakeup1(void *chan);
 
+// Per-CPU run queues. Every RUNNABLE process is on exactly one of them.
+// Processes are queued with ptable.lock held (it orders the state change
+// against the swtch away from the process), but a CPU looking for work
+// only takes its own queue's lock, or a victim's when stealing.
+//
+// SCHED_PRIO processes run first. A queue keeps one FIFO list per
+// priority level (0 is the best) and a bitmap of the non-empty levels,
+// so picking the next process is O(1). Processes that wait AGETICKS on a
+// list move up one level (aging), and go back to their nice level the
+// next time they are queued.
+//
+// SCHED_FAIR processes, the default, share what is left in proportion
+// to their weights. Each one is charged its TSC run time scaled by
+// NICE_0_WEIGHT/weight (vruntime), and the queue runs the one with the
+// least vruntime: the leftmost node of a red-black tree. vruntime only
+// means something next to the queue's min_vruntime, so a process leaving
+// a queue keeps its distance from it (vlag) and gets it back on the
+// queue it joins next.
+#define NPRIOWORDS ((NPRIO + 31) / 32)
+#define WAKEUP_CREDIT (1ULL << 24)  // most vruntime a sleeper can be owed
+#define CPUOK(p, cpu) ((cpu) >= 0 && ((p)->cpumask >> (cpu) & 1))
+
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO];
+  struct proc *tail[NPRIO];
+  uint bitmap[NPRIOWORDS];
+  int len;
+  uint lastage;                // ticks at the last aging pass
+  struct rbroot fair;          // SCHED_FAIR processes by vruntime
+  struct rbnode *leftmost;     // least vruntime in fair
+  uint64 min_vruntime;         // never decreases
+};
+
+// 2^32 / weight for every nice value, with weights from Linux:
+// each nice step is worth about 10% of CPU time.
+static const uint prio_to_wmult[NPRIO] = {
+  /* -20 */     48388,     59856,     76040,     92818,    118348,
+  /* -15 */    147320,    184698,    229616,    287308,    360437,
+  /* -10 */    449829,    563644,    704093,    875809,   1099582,
+  /*  -5 */   1376151,   1717300,   2157191,   2708050,   3363326,
+  /*   0 */   4194304,   5237765,   6557202,   8165337,  10153587,
+  /*   5 */  12820798,  15790321,  19976592,  24970740,  31350126,
+  /*  10 */  39045157,  49367440,  61356676,  76695844,  95443717,
+  /*  15 */ 119304647, 148102320, 186737708, 238609294, 286331153,
+};
+
+static struct runq runqs[NCPU];
+
 void
 pinit(void)
 {
+  struct runq *rq;
+
   initlock(&ptable.lock, "ptable");
+  for(rq = runqs; rq < &runqs[NCPU]; rq++)
+    initlock(&rq->lock, "runq");
+}
+
+// Append p to the list of level p->rqprio. Caller holds rq->lock.
+static void
+runqlink(struct runq *rq, struct proc *p)
+{
+  int i = p->rqprio;
+
+  p->rqnext = 0;
+  if(rq->tail[i])
+    rq->tail[i]->rqnext = p;
+  else
+    rq->head[i] = p;
+  rq->tail[i] = p;
+  rq->bitmap[i / 32] |= 1 << (i % 32);
+  rq->len++;
+}
+
+// Remove the head of level i. Caller holds rq->lock.
+static struct proc*
+runqunlink(struct runq *rq, int i)
+{
+  struct proc *p = rq->head[i];
+
+  rq->head[i] = p->rqnext;
+  if(rq->head[i] == 0){
+    rq->tail[i] = 0;
+    rq->bitmap[i / 32] &= ~(1 << (i % 32));
+  }
+  rq->len--;
+  p->rq = 0;
+  return p;
+}
+
+// Insert p into the fair tree at p->vruntime. Caller holds rq->lock.
+static void
+fairlink(struct runq *rq, struct proc *p)
+{
+  struct rbnode **link = &rq->fair.node, *parent = 0;
+  int leftmost = 1;
+
+  while(*link){
+    parent = *link;
+    if(p->vruntime < rb_entry(parent, struct proc, rbnode)->vruntime)
+      link = &parent->left;
+    else {
+      link = &parent->right;
+      leftmost = 0;
+    }
+  }
+  rb_link(&p->rbnode, parent, link);
+  rb_insert_fixup(&rq->fair, &p->rbnode);
+  if(leftmost)
+    rq->leftmost = &p->rbnode;
+  rq->len++;
+}
+
+// Remove the process with the least vruntime. Caller holds rq->lock.
+static struct proc*
+fairunlink(struct runq *rq)
+{
+  struct proc *p = rb_entry(rq->leftmost, struct proc, rbnode);
+
+  rq->leftmost = rb_next(rq->leftmost);
+  rb_erase(&rq->fair, &p->rbnode);
+  p->vlag = p->vruntime - rq->min_vruntime;
+  rq->len--;
+  p->rq = 0;
+  return p;
+}
+
+// Remove p from wherever it is on rq. Caller holds rq->lock.
+static void
+runqremove(struct runq *rq, struct proc *p)
+{
+  struct proc **pp, *prev = 0;
+  int i = p->rqprio;
+
+  if(i < 0){
+    if(rq->leftmost == &p->rbnode)
+      rq->leftmost = rb_next(rq->leftmost);
+    rb_erase(&rq->fair, &p->rbnode);
+    p->vlag = p->vruntime - rq->min_vruntime;
+  } else {
+    for(pp = &rq->head[i]; *pp != p; pp = &(*pp)->rqnext)
+      prev = *pp;
+    *pp = p->rqnext;
+    if(rq->tail[i] == p)
+      rq->tail[i] = prev;
+    if(rq->head[i] == 0)
+      rq->bitmap[i / 32] &= ~(1 << (i % 32));
+  }
+  rq->len--;
+  p->rq = 0;
+}
+
+// Advance min_vruntime towards the least vruntime on the queue or,
+// if less, the one of the process that is running. Caller holds rq->lock.
+static void
+updatemin(struct runq *rq, uint64 curv)
+{
+  uint64 v = curv;
+
+  if(rq->leftmost && rb_entry(rq->leftmost, struct proc, rbnode)->vruntime < v)
+    v = rb_entry(rq->leftmost, struct proc, rbnode)->vruntime;
+  if(v > rq->min_vruntime)
+    rq->min_vruntime = v;
+}
+
+// Charge the running process p for the TSC cycles since it was last
+// charged, scaled by its weight.
+static void
+updatecurr(struct proc *p)
+{
+  struct runq *rq = &runqs[cpuid()];
+  uint64 now = rdtsc();
+  uint64 delta = now - p->exec_start;
+
+  p->exec_start = now;
+  // Slices are far shorter; the cap keeps delta * wmult within 64 bits.
+  if(delta > 0xffffffff)
+    delta = 0xffffffff;
+  p->vruntime += (delta * prio_to_wmult[p->nice - PRIO_MIN]) >> 22;
+  acquire(&rq->lock);
+  updatemin(rq, p->vruntime);
+  p->vlag = p->vruntime - rq->min_vruntime;
+  release(&rq->lock);
+}
+
+static void
+runqput(struct runq *rq, struct proc *p)
+{
+  acquire(&rq->lock);
+  if(p->class == SCHED_PRIO){
+    p->rqprio = p->nice - PRIO_MIN;
+    p->rqtime = ticks;
+    runqlink(rq, p);
+  } else {
+    if(p->vlag < -(long long)WAKEUP_CREDIT)
+      p->vlag = -(long long)WAKEUP_CREDIT;
+    p->rqprio = -1;
+    p->vruntime = rq->min_vruntime + p->vlag;
+    fairlink(rq, p);
+  }
+  p->rq = rq;
+  release(&rq->lock);
+}
+
+static struct proc*
+runqget(struct runq *rq)
+{
+  struct proc *p = 0;
+  int w;
+
+  if(rq->len == 0)  // racy peek, saves the lock on an idle queue
+    return 0;
+  acquire(&rq->lock);
+  for(w = 0; w < NPRIOWORDS; w++){
+    if(rq->bitmap[w]){
+      p = runqunlink(rq, w * 32 + __builtin_ctz(rq->bitmap[w]));
+      break;
+    }
+  }
+  if(p == 0 && rq->leftmost)
+    p = fairunlink(rq);
+  release(&rq->lock);
+  return p;
+}
+
+// p was taken off some queue to run on rq's CPU:
+// move its vruntime into rq's frame.
+static void
+runqenter(struct runq *rq, struct proc *p)
+{
+  int cpu = rq - runqs;
+
+  if(p->lastcpu != cpu){
+    if(p->lastcpu >= 0)
+      p->nmigrate++;
+    p->lastcpu = cpu;
+  }
+  acquire(&rq->lock);
+  p->vruntime = rq->min_vruntime + p->vlag;
+  release(&rq->lock);
+  p->exec_start = rdtsc();
+}
+
+// Count cycles in the latency histogram h.
+static void
+histadd(uint *h, uint64 cycles)
+{
+  uint v;
+  int b;
+
+  if(cycles >> (LATSHIFT + NLATBUCKET - 1)){
+    h[NLATBUCKET - 1]++;
+    return;
+  }
+  v = cycles >> LATSHIFT;
+  b = v ? 32 - __builtin_clz(v) : 0;
+  h[b]++;
+}
+
+// The scheduler is about to switch to p: record how long it waited.
+static void
+dispatch(struct cpu *c, struct proc *p)
+{
+  uint64 now = rdtsc();
+
+  histadd(p->woken ? p->hist.wakeup : p->hist.requeue, now - p->readytsc);
+  histadd(p->woken ? c->hist.wakeup : c->hist.requeue, now - p->readytsc);
+  p->dispatchtsc = now;
+  c->swtchtsc = now;
+}
+
+// p runs again after the scheduler's swtch(). Caller holds ptable.lock.
+static void
+swtchdone(struct proc *p)
+{
+  uint64 d = rdtsc() - mycpu()->swtchtsc;
+
+  histadd(p->hist.swtch, d);
+  histadd(mycpu()->hist.swtch, d);
+}
+
+// Move processes that waited AGETICKS one level up, at most once a tick.
+static void
+runqage(struct runq *rq)
+{
+  struct proc *p;
+  int i;
+
+  if(rq->lastage == ticks || rq->len == 0)
+    return;
+  acquire(&rq->lock);
+  rq->lastage = ticks;
+  // Upwards, so that nothing climbs more than one level per pass.
+  for(i = 1; i < NPRIO; i++){
+    while((p = rq->head[i]) != 0 && ticks - p->rqtime >= AGETICKS){
+      runqunlink(rq, i);
+      p->rqprio = i - 1;
+      p->rqtime = ticks;
+      runqlink(rq, p);
+      p->rq = rq;
+    }
+  }
+  release(&rq->lock);
+}
+
+// The first process on rq that may run on cpu and, unless gang is 0,
+// belongs to gang: strict levels first, then the least vruntime.
+// Caller holds rq->lock.
+static struct proc*
+runqfind(struct runq *rq, int cpu, int gang)
+{
+  struct rbnode *n;
+  struct proc *p;
+  int i;
+
+  for(i = 0; i < NPRIO; i++)
+    for(p = rq->head[i]; p; p = p->rqnext)
+      if(CPUOK(p, cpu) && (gang == 0 || p->gang == gang))
+        return p;
+  for(n = rq->leftmost; n; n = rb_next(n)){
+    p = rb_entry(n, struct proc, rbnode);
+    if(CPUOK(p, cpu) && (gang == 0 || p->gang == gang))
+      return p;
+  }
+  return 0;
+}
+
+// Take the first process allowed on self's CPU from the busiest other queue.
+static struct proc*
+runqsteal(struct runq *self)
+{
+  struct runq *rq, *victim = 0;
+  struct proc *p;
+
+  for(rq = runqs; rq < &runqs[ncpu]; rq++)
+    if(rq != self && rq->len > 0 && (victim == 0 || rq->len > victim->len))
+      victim = rq;
+  if(victim == 0)
+    return 0;
+  acquire(&victim->lock);
+  if((p = runqfind(victim, self - runqs, 0)) != 0)
+    runqremove(victim, p);
+  release(&victim->lock);
+  return p;
+}
+
+// Gang scheduling. Processes with the same nonzero p->gang spin-wait
+// on each other, so they should run at the same time. When a CPU
+// dispatches a member and no gang holds a slot, the member's gang gets
+// one for GANGTICKS: every CPU runs its runnable members before anything
+// else, and gangstart() interrupts the CPUs it needs. Members are
+// charged vruntime like everybody else, so outside their slots they
+// queue behind what they got ahead of.
+static struct {
+  int gang;                    // gang holding the slot, 0 if none
+  uint until;                  // ticks when the slot ends
+} cosched;
+
+// The gang holding the slot, or 0. Read without a lock: a stale
+// answer only costs one dispatch out of step.
+static int
+gangslot(void)
+{
+  int g = cosched.gang;
+
+  return (int)(cosched.until - ticks) > 0 ? g : 0;
+}
+
+// Take a runnable member of gang g allowed on self's CPU, from self
+// or, failing that, the other queues.
+static struct proc*
+gangpick(struct runq *self, int g)
+{
+  struct runq *rq;
+  struct proc *p = 0;
+  int cpu = self - runqs, i;
+
+  for(i = 0; i < ncpu && p == 0; i++){
+    rq = &runqs[(cpu + i) % ncpu];
+    if(rq->len == 0)
+      continue;
+    acquire(&rq->lock);
+    if((p = runqfind(rq, cpu, g)) != 0)
+      runqremove(rq, p);
+    release(&rq->lock);
+  }
+  return p;
+}
+
+// Give p's gang the slot, and send a CPU for each of its other
+// runnable members: idle ones first, then CPUs running outsiders,
+// which get IRQ_RESCHED to make them yield. Caller holds ptable.lock.
+static void
+gangstart(struct proc *p)
+{
+  struct proc *q;
+  struct cpu *c;
+  int n = 0, pass;
+
+  cosched.gang = p->gang;
+  cosched.until = ticks + GANGTICKS;
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+    if(q != p && q->state == RUNNABLE && q->gang == p->gang)
+      n++;
+  for(pass = 0; pass < 2; pass++){
+    for(c = cpus; c < &cpus[ncpu] && n > 0; c++){
+      if(c == mycpu() || (c->proc != 0) != pass)
+        continue;
+      if(c->proc && c->proc->gang == p->gang)
+        continue;
+      // A CPU between processes will look at the slot by itself.
+      if(c->idle)
+        lapicipi(c->apicid, T_IRQ0 + IRQ_WAKE);
+      else if(c->proc)
+        lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+      n--;
+    }
+  }
+}
+
+// Runnable processes on cpu, counting the one it is running.
+static int
+cpuload(int cpu)
+{
+  return runqs[cpu].len + (cpus[cpu].proc != 0);
+}
+
+// The queue for p, which just became runnable: the least loaded
+// one p may run on. On a tie the CPU it last ran on, whose cache
+// may still be warm, then this CPU.
+static struct runq*
+runqpick(struct proc *p)
+{
+  int cpu, best = -1;
+
+  if(CPUOK(p, p->lastcpu))
+    best = p->lastcpu;
+  else if(CPUOK(p, cpuid()))
+    best = cpuid();
+  for(cpu = 0; cpu < ncpu; cpu++)
+    if(CPUOK(p, cpu) && (best < 0 || cpuload(cpu) < cpuload(best)))
+      best = cpu;
+  return &runqs[best];
+}
+
+// Idle CPUs halt, so someone has to wake them for work queued on rq:
+// rq's own CPU or, when that one is busy and rq has work to spare,
+// any idle CPU, which will steal it.
+static void
+runqkick(struct runq *rq)
+{
+  struct cpu *c = &cpus[rq - runqs];
+
+  if(!c->idle && rq->len > 1)
+    for(c = cpus; c < &cpus[ncpu] && !c->idle; c++)
+      ;
+  if(c < &cpus[ncpu] && c->idle && c != mycpu())
+    lapicipi(c->apicid, T_IRQ0 + IRQ_WAKE);
+}
+
+// Halt until an interrupt, unless something was queued on rq
+// meanwhile. Pairs with runqkick(): either we see rq->len, or the
+// CPU queuing the work sees c->idle.
+static void
+runqidle(struct cpu *c, struct runq *rq)
+{
+  cli();
+  xchg(&c->idle, 1);
+  if(rq->len == 0)
+    stihlt();
+  xchg(&c->idle, 0);
+}
+
+// Make p RUNNABLE and queue it on rq. Caller holds ptable.lock.
+static void
+setrunnable(struct proc *p, struct runq *rq)
+{
+  if(!holding(&ptable.lock))
+    panic("setrunnable");
+  if(p->state == RUNNING)
+    updatecurr(p);
+  if(p->state != RUNNABLE){  // not just moving to another queue
+    p->readytsc = rdtsc();
+    p->woken = p->state != RUNNING;
+  }
+  p->state = RUNNABLE;
+  runqput(rq, p);
+  runqkick(rq);
+}
+
+// Sleeping processes hang off a hash table of wait queues keyed by
+// chan, so wakeup() only looks at the waiters of its channel.
+// Protected by ptable.lock, like p->state.
+#define SLEEPQBITS 6
+#define NSLEEPQ (1 << SLEEPQBITS)
+
+static struct proc *sleepq[NSLEEPQ];
+
+static struct proc**
+sleepqhead(void *chan)
+{
+  return &sleepq[((uint)chan * 2654435761U) >> (32 - SLEEPQBITS)];
+}
+
+static void
+sleepqadd(struct proc *p)
+{
+  struct proc **head = sleepqhead(p->chan);
+
+  p->sqnext = *head;
+  p->sqprev = head;
+  if(*head)
+    (*head)->sqprev = &p->sqnext;
+  *head = p;
+}
+
+static void
+sleepqdel(struct proc *p)
+{
+  *p->sqprev = p->sqnext;
+  if(p->sqnext)
+    p->sqnext->sqprev = p->sqprev;
+  p->sqnext = 0;
+  p->sqprev = 0;
 }
 
 // Must be called with interrupts disabled
@@ -95,6 +618,23 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->nice = 0;
+  p->class = SCHED_FAIR;
+  p->vlag = 0;
+  p->cpumask = ~0;
+  p->gang = 0;
+  p->lastcpu = -1;
+  p->nmigrate = 0;
+  p->thread = 0;
+  p->ustack = 0;
+  p->pgdir = 0;
+  memset(&p->hist, 0, sizeof(p->hist));
+  p->minflt = p->majflt = p->cowflt = 0;
+  p->nswapout = p->nswapin = 0;
+  memset(p->wss, 0, sizeof(p->wss));
+  p->wsssamples = 0;
+  p->nlocked = 0;
+  p->mlockflags = 0;
 
   release(&ptable.lock);
 
@@ -155,28 +695,75 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
-  p->state = RUNNABLE;
+  setrunnable(p, runqpick(p));
 
   release(&ptable.lock);
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch here.  "Return" to the thread function.
+static void
+kthreadret(void)
+{
+  // Still holding ptable.lock from scheduler.
+  swtchdone(myproc());
+  release(&ptable.lock);
+}
+
+// Start a kernel thread running fn, which must never return.
+// It has no user memory and never enters user space.
+struct proc*
+kthread_create(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == NULL)
+    return NULL;
+  if((p->pgdir = setupkvm()) == 0)
+    panic("kthread_create: out of memory?");
+  p->sz = 0;
+  // kthreadret() returns through the slot allocproc() set to trapret.
+  *((uint*)p->tf - 1) = (uint)fn;
+  p->context->eip = (uint)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  setrunnable(p, runqpick(p));
+  release(&ptable.lock);
+  return p;
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
 {
   uint sz;
-  struct proc *curproc = myproc();
+  struct proc *curproc = myproc(), *p;
+  struct sleeplock *locked = vmbegin(curproc);
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0){
+      vmend(locked);
       return -1;
+    }
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    unmapuvm(curproc->pgdir, sz + n, sz);  // other threads may run in it
+    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0){
+      vmend(locked);
       return -1;
+    }
   }
-  curproc->sz = sz;
+  // Threads see the same heap.
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state != UNUSED && p->pgdir == curproc->pgdir)
+      p->sz = sz;
+  release(&ptable.lock);
+  if(n < 0)
+    mlocksync(curproc);
+  vmend(locked);
   switchuvm(curproc);
   return 0;
 }
@@ -190,6 +777,7 @@ fork(void)
   int i, pid;
   struct proc *np;
   struct proc *curproc = myproc();
+  struct sleeplock *locked;
 
   // Allocate process.
   if((np = allocproc()) == 0){
@@ -201,7 +789,13 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == NULL){
+  locked = vmbegin(curproc);
+  np->pgdir = copyuvm(curproc->pgdir, curproc->sz);
+  // Our threads on other CPUs must not keep writing to pages
+  // copyuvm() made copy-on-write.
+  tlbshootdown(curproc->pgdir);
+  vmend(locked);
+  if(np->pgdir == NULL){
 #ifdef DEBUG_FORK
     cprintf("error at copyuvm\n");
 #endif
@@ -223,18 +817,231 @@ fork(void)
   np->cwd = idup(curproc->cwd);
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+  memmove(np->advice, curproc->advice, sizeof(curproc->advice));
+  np->nice = curproc->nice;
+  np->class = curproc->class;
+  np->cpumask = curproc->cpumask;
+  np->gang = curproc->gang;
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  setrunnable(np, runqpick(np));
+
+  release(&ptable.lock);
+
+  return pid;
+}
+
+// Create a thread that runs fn(arg) in the caller's address space on
+// the user stack [stack, stack+PGSIZE). It gets its own references to
+// the caller's open files and working directory, and belongs to the
+// caller's process: the parent of every thread is the process that is
+// not a thread itself. Returns its pid, which join() hands back.
+int
+clone(void (*fn)(void*), void *arg, void *stack)
+{
+  int i, pid;
+  uint sp, ustack[2];
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  sp = (uint)stack + PGSIZE - sizeof(ustack);
+  if((uint)stack % 4 != 0 || (uint)stack + PGSIZE > curproc->sz ||
+     (uint)stack + PGSIZE < (uint)stack)
+    return -1;
+  // copyout() does not fault pages in.
+  if(faultin(sp) < 0 || faultin(sp + sizeof(ustack) - 1) < 0)
+    return -1;
+  ustack[0] = 0xffffffff;  // fake return PC: fn must call exit()
+  ustack[1] = (uint)arg;
+  if(copyout(curproc->pgdir, sp, ustack, sizeof(ustack)) < 0)
+    return -1;
+
+  if((np = allocproc()) == 0)
+    return -1;
+  np->pgdir = curproc->pgdir;
+  np->sz = curproc->sz;
+  np->parent = curproc->thread ? curproc->parent : curproc;
+  np->thread = 1;
+  np->ustack = stack;
+  *np->tf = *curproc->tf;
+  np->tf->eip = (uint)fn;
+  np->tf->esp = sp;
+
+  for(i = 0; i < NOFILE; i++)
+    if(curproc->ofile[i])
+      np->ofile[i] = filedup(curproc->ofile[i]);
+  np->cwd = idup(curproc->cwd);
+
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+  memmove(np->advice, curproc->advice, sizeof(curproc->advice));
+  np->mlockflags = curproc->mlockflags;
+  np->nice = curproc->nice;
+  np->class = curproc->class;
+  np->cpumask = curproc->cpumask;
+  np->gang = curproc->gang;
 
   pid = np->pid;
 
   acquire(&ptable.lock);
 
-  np->state = RUNNABLE;
+  setrunnable(np, runqpick(np));
 
   release(&ptable.lock);
 
   return pid;
 }
 
+// Does another process share p's address space? Looks without
+// ptable.lock, which a faulting caller may hold: only threads of the
+// same address space add users to it, so a process alone in it
+// cannot race with one being added.
+int
+vmshared(struct proc *p)
+{
+  struct proc *q;
+
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+    if(q != p && q->state != UNUSED && q->pgdir == p->pgdir)
+      return 1;
+  return 0;
+}
+
+// Is pgdir loaded on some CPU? Caller holds ptable.lock.
+int
+vmrunning(pde_t *pgdir)
+{
+  struct proc *p;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state == RUNNING && p->pgdir == pgdir)
+      return 1;
+  return 0;
+}
+
+// Make every CPU with pgdir loaded, or with pgdir 0 every CPU,
+// flush its TLB, and wait until they have. Call it after clearing
+// or write-protecting PTEs of pgdir and before freeing or sharing
+// their pages, since the threads on other CPUs may still reach them
+// through stale TLB entries. Caller must not hold a spinlock: the
+// CPUs flush from an interrupt, and one of them may be spinning for
+// the lock with interrupts off.
+void
+tlbshootdown(pde_t *pgdir)
+{
+  uint req[NCPU], mask = 0;
+  struct cpu *c;
+
+  acquire(&ptable.lock);
+  for(c = cpus; c < &cpus[ncpu]; c++){
+    if(c == mycpu() || !c->proc || (pgdir && c->proc->pgdir != pgdir))
+      continue;
+    mask |= 1 << (c - cpus);
+    req[c - cpus] = ++c->tlbreq;
+    lapicipi(c->apicid, T_IRQ0 + IRQ_TLB);
+  }
+  lcr3(rcr3());
+  release(&ptable.lock);
+
+  for(c = cpus; c < &cpus[ncpu]; c++)
+    if(mask & (1 << (c - cpus)))
+      while((int)(c->tlbdone - req[c - cpus]) < 0)
+        ;
+}
+
+// Handle IRQ_TLB: flush, then report every request made before.
+void
+tlbflushed(void)
+{
+  struct cpu *c = mycpu();
+  uint req = c->tlbreq;
+
+  lcr3(rcr3());
+  c->tlbdone = req;
+}
+
+// Give p the new address space pgdir, as exec() does. Returns whether
+// the old one is still used by other threads and must not be freed.
+int
+setpgdir(struct proc *p, pde_t *pgdir)
+{
+  pde_t *old = p->pgdir;
+  struct proc *q;
+  int shared = 0;
+
+  acquire(&ptable.lock);
+  p->pgdir = pgdir;
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+    if(q->state != UNUSED && q->pgdir == old)
+      shared = 1;
+  release(&ptable.lock);
+  return shared;
+}
+
+// Free ZOMBIE p, and its address space unless a thread still uses it.
+// Caller holds ptable.lock.
+static void
+reap(struct proc *p)
+{
+  pde_t *pgdir = p->pgdir;
+  struct proc *q;
+
+  kfree(p->kstack);
+  p->kstack = 0;
+  p->pgdir = 0;
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  p->state = UNUSED;
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+    if(q->state != UNUSED && q->pgdir == pgdir)
+      return;
+  freevm(pgdir);
+}
+
+// Mark p killed and wake it if it sleeps. Caller holds ptable.lock.
+static void
+killlocked(struct proc *p)
+{
+  p->killed = 1;
+  // Wake process from sleep if necessary.
+  if(p->state == SLEEPING){
+    sleepqdel(p);
+    setrunnable(p, runqpick(p));
+  }
+}
+
+// A process is exiting: kill its threads and reap them, so that
+// none outlives it.
+static void
+endthreads(struct proc *curproc)
+{
+  struct proc *p;
+  int n;
+
+  acquire(&ptable.lock);
+  for(;;){
+    n = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p->parent != curproc || !p->thread)
+        continue;
+      if(p->state == ZOMBIE)
+        reap(p);
+      else {
+        killlocked(p);
+        n++;
+      }
+    }
+    if(n == 0)
+      break;
+    sleep(curproc, &ptable.lock);
+  }
+  release(&ptable.lock);
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
@@ -250,6 +1057,9 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
+  if(!curproc->thread)
+    endthreads(curproc);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
@@ -258,7 +1068,7 @@ exit(void)
     }
   }
 
-  begin_op();
+  begin_op(putblocks());
   iput(curproc->cwd);
   end_op();
   curproc->cwd = 0;
@@ -297,20 +1107,13 @@ wait(void)
     // Scan through table looking for exited children.
     havekids = 0;
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
+      if(p->parent != curproc || p->thread)  // threads are join()ed
         continue;
       havekids = 1;
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
+        reap(p);
         release(&ptable.lock);
         return pid;
       }
@@ -327,6 +1130,43 @@ wait(void)
   }
 }
 
+// Wait for a thread of the caller's process to exit, store the stack
+// it was given by clone() in *stack and return its pid.
+// Return -1 if the process has no other threads.
+int
+join(void **stack)
+{
+  struct proc *p;
+  struct proc *curproc = myproc();
+  struct proc *leader = curproc->thread ? curproc->parent : curproc;
+  int havethreads, pid;
+  void *ustack;
+
+  acquire(&ptable.lock);
+  for(;;){
+    havethreads = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p->parent != leader || !p->thread || p == curproc)
+        continue;
+      havethreads = 1;
+      if(p->state == ZOMBIE){
+        pid = p->pid;
+        ustack = p->ustack;
+        reap(p);
+        release(&ptable.lock);
+        *stack = ustack;
+        return pid;
+      }
+    }
+    if(!havethreads || curproc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+    // Exiting threads wake their parent, the leader.
+    sleep(leader, &ptable.lock);
+  }
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -340,34 +1180,57 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  struct runq *rq = &runqs[c - cpus];
+  int g;
   c->proc = 0;
   
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
-
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      c->proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-
-      swtch(&(c->scheduler), p->context);
-      switchkvm();
+    // Run the members of the gang holding the slot first, then the
+    // best process of our own queue, or steal from the busiest one.
+    runqage(rq);
+    p = 0;
+    if((g = gangslot()) != 0)
+      p = gangpick(rq, g);
+    if(p == 0 && (p = runqget(rq)) == 0 && (p = runqsteal(rq)) == 0){
+      runqidle(c, rq);
+      continue;
+    }
+    timertick();
 
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      c->proc = 0;
+    // ptable.lock is still held by the CPU that queued p
+    // until p's context has been saved.
+    acquire(&ptable.lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: queued proc not runnable");
+    if(!CPUOK(p, c - cpus)){  // affinity changed while p was picked
+      setrunnable(p, runqpick(p));
+      release(&ptable.lock);
+      continue;
     }
+    if(p->gang && gangslot() == 0)
+      gangstart(p);
+
+    runqenter(rq, p);
+    dispatch(c, p);
+
+    // Switch to chosen process.  It is the process's job
+    // to release ptable.lock and then reacquire it
+    // before jumping back to us.
+    c->proc = p;
+    c->nswitch++;
+    switchuvm(p);
+    p->state = RUNNING;
+
+    swtch(&(c->scheduler), p->context);
+    switchkvm();
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
     release(&ptable.lock);
-
   }
 }
 
@@ -392,8 +1255,13 @@ sched(void)
     panic("sched running");
   if(readeflags()&FL_IF)
     panic("sched interruptible");
+  if(p->state != RUNNABLE)  // yield() charged it already in setrunnable()
+    updatecurr(p);
+  histadd(p->hist.slice, rdtsc() - p->dispatchtsc);
+  histadd(mycpu()->hist.slice, rdtsc() - p->dispatchtsc);
   intena = mycpu()->intena;
   swtch(&p->context, mycpu()->scheduler);
+  swtchdone(p);
   mycpu()->intena = intena;
 }
 
@@ -401,8 +1269,10 @@ sched(void)
 void
 yield(void)
 {
+  struct proc *p = myproc();
+
   acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  setrunnable(p, CPUOK(p, cpuid()) ? &runqs[cpuid()] : runqpick(p));
   sched();
   release(&ptable.lock);
 }
@@ -414,6 +1284,7 @@ forkret(void)
 {
   static BOOL first = TRUE;
   // Still holding ptable.lock from scheduler.
+  swtchdone(myproc());
   release(&ptable.lock);
 
   if (first) {
@@ -423,6 +1294,7 @@ forkret(void)
     first = FALSE;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    bsuminit(ROOTDEV);  // after recovery, which may change the bitmap
 //    swapinit();
 #ifdef SWAPFILE
     swapinit_file();
@@ -459,6 +1331,7 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  sleepqadd(p);
 #ifdef DEBUG_SLEEP
   cprintf("sleep: pid: %d:going to sleep on %s\n",p->pid, lk->name);
 #endif
@@ -483,11 +1356,15 @@ sleep(void *chan, struct spinlock *lk)
 static void
 wakeup1(void *chan)
 {
-  struct proc *p;
+  struct proc *p, *next;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  for(p = *sleepqhead(chan); p; p = next){
+    next = p->sqnext;
+    if(p->chan == chan){
+      sleepqdel(p);
+      setrunnable(p, runqpick(p));
+    }
+  }
 }
 
 // Wake up all processes sleeping on chan.
@@ -500,6 +1377,205 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Wake up at most n processes sleeping on chan; return how many.
+int
+wakeupn(void *chan, int n)
+{
+  struct proc *p, *next;
+  int woken = 0;
+
+  acquire(&ptable.lock);
+  for(p = *sleepqhead(chan); p && woken < n; p = next){
+    next = p->sqnext;
+    if(p->chan == chan){
+      sleepqdel(p);
+      setrunnable(p, runqpick(p));
+      woken++;
+    }
+  }
+  release(&ptable.lock);
+  return woken;
+}
+
+// Set the nice value of process pid (0 for the caller), clamped to
+// [PRIO_MIN, PRIO_MAX]. Takes effect the next time it is queued.
+int
+setpriority(int pid, int nice)
+{
+  struct proc *p;
+
+  if(nice < PRIO_MIN)
+    nice = PRIO_MIN;
+  if(nice > PRIO_MAX)
+    nice = PRIO_MAX;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != UNUSED && (p->pid == pid || (pid == 0 && p == myproc()))){
+      p->nice = nice;
+      release(&ptable.lock);
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Move process pid (0 for the caller) to scheduling class cls.
+// Returns the old class. Takes effect the next time it is queued.
+int
+setclass(int pid, int cls)
+{
+  struct proc *p;
+  int old;
+
+  if(cls != SCHED_FAIR && cls != SCHED_PRIO)
+    return -1;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != UNUSED && (p->pid == pid || (pid == 0 && p == myproc()))){
+      old = p->class;
+      p->class = cls;
+      release(&ptable.lock);
+      return old;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+int
+getpriority(int pid, int *nice)
+{
+  struct proc *p;
+  int n;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != UNUSED && (p->pid == pid || (pid == 0 && p == myproc()))){
+      n = p->nice;
+      release(&ptable.lock);
+      *nice = n;  // user memory: may fault, so not under the lock
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Restrict process pid (0 for the caller) to the CPUs in mask.
+// A queued process moves to an allowed queue right away, a running
+// one when it is next preempted; the caller gives up a CPU it no
+// longer may use before returning.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *p;
+  struct runq *rq;
+  int moved, resched;
+
+  mask &= (1 << ncpu) - 1;
+  if(mask == 0)
+    return -1;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != UNUSED && (p->pid == pid || (pid == 0 && p == myproc()))){
+      p->cpumask = mask;
+      // p->rq is 0 while a CPU is picking p; the scheduler rechecks then.
+      if(p->state == RUNNABLE && (rq = p->rq) != 0 && !CPUOK(p, rq - runqs)){
+        acquire(&rq->lock);
+        if((moved = p->rq == rq) != 0)
+          runqremove(rq, p);
+        release(&rq->lock);
+        if(moved)
+          setrunnable(p, runqpick(p));
+      }
+      resched = p == myproc() && !CPUOK(p, cpuid());
+      release(&ptable.lock);
+      if(resched)
+        yield();
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Put process pid (0 for the caller) in co-scheduling group gang,
+// or with gang 0 take it out. Children and threads inherit the group.
+int
+setgang(int pid, int gang)
+{
+  struct proc *p;
+
+  if(gang < 0)
+    return -1;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != UNUSED && (p->pid == pid || (pid == 0 && p == myproc()))){
+      p->gang = gang;
+      release(&ptable.lock);
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+int
+getaffinity(int pid, uint *mask)
+{
+  struct proc *p;
+  uint m;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != UNUSED && (p->pid == pid || (pid == 0 && p == myproc()))){
+      m = p->cpumask & ((1 << ncpu) - 1);
+      release(&ptable.lock);
+      *mask = m;  // user memory: may fault, so not under the lock
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Copy the latency histograms of process pid, or with pid -1 those
+// of every CPU added up, to kernel memory h.
+int
+schedstat(int pid, struct schedhist *h)
+{
+  struct proc *p;
+  struct cpu *c;
+  int i;
+
+  memset(h, 0, sizeof(*h));
+  h->tsckhz = tsckhz();
+  acquire(&ptable.lock);
+  if(pid == -1){
+    for(c = cpus; c < &cpus[ncpu]; c++){
+      for(i = 0; i < NLATBUCKET; i++){
+        h->wakeup[i] += c->hist.wakeup[i];
+        h->requeue[i] += c->hist.requeue[i];
+        h->slice[i] += c->hist.slice[i];
+        h->swtch[i] += c->hist.swtch[i];
+      }
+    }
+    release(&ptable.lock);
+    return 0;
+  }
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != UNUSED && p->pid == pid){
+      memmove(h, &p->hist, sizeof(*h));
+      h->tsckhz = tsckhz();
+      release(&ptable.lock);
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
@@ -511,10 +1587,7 @@ kill(int pid)
   acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+      killlocked(p);
       release(&ptable.lock);
       return 0;
     }
@@ -625,7 +1698,23 @@ procdumpWrite(struct procinfo *pi_arr, struct cpuinfo *cpui_arr)
 
         pi_arr[pi_arr_i].file_count = file_count;
         pi_arr[pi_arr_i].size = p->sz;
+        uint resident = 0, swapped = 0, locked = 0;
+        if (p->state != EMBRYO)
+            countuvm(p->pgdir, p->sz, &resident, &swapped, &locked);
+        pi_arr[pi_arr_i].resident = resident * PGSIZE;
+        pi_arr[pi_arr_i].swapped = swapped * PGSIZE;
+        pi_arr[pi_arr_i].locked = locked * PGSIZE;
+        pi_arr[pi_arr_i].minflt = p->minflt;
+        pi_arr[pi_arr_i].majflt = p->majflt;
+        pi_arr[pi_arr_i].cowflt = p->cowflt;
+        pi_arr[pi_arr_i].swapout = p->nswapout;
+        pi_arr[pi_arr_i].swapin = p->nswapin;
         pi_arr[pi_arr_i].pid = p->pid;
+        pi_arr[pi_arr_i].nice = p->nice;
+        pi_arr[pi_arr_i].class = p->class;
+        pi_arr[pi_arr_i].cpumask = p->cpumask & ((1 << ncpu) - 1);
+        pi_arr[pi_arr_i].lastcpu = p->lastcpu;
+        pi_arr[pi_arr_i].migrations = p->nmigrate;
 
         strncpy(pi_arr[pi_arr_i].state, state, 16);
         strncpy(pi_arr[pi_arr_i].name,p->name, 16);
@@ -643,13 +1732,14 @@ procdumpWrite(struct procinfo *pi_arr, struct cpuinfo *cpui_arr)
 
     release(&ptable.lock);
     for (int i = 0; i < ncpu; ++i) {
-        if (cpus[i].proc->state != RUNNING)
-            continue;
+        struct proc *running = cpus[i].proc;
 
         cpui_arr[cpui_arr_i].id = cpus[i].apicid;
-        cpui_arr[cpui_arr_i].pid = cpus[i].proc->pid;
+        cpui_arr[cpui_arr_i].pid = running ? running->pid : 0;
+        cpui_arr[cpui_arr_i].nswitch = cpus[i].nswitch;
+        cpui_arr[cpui_arr_i].runqlen = runqs[i].len;
 
         ++cpui_arr_i;
     }
-    return 0;
+    return cpui_arr_i;
 }
\ No newline at end of file
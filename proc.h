@@ -1,3 +1,6 @@
+#include "rbtree.h"
+#include "schedstat.h"
+
 // Per-CPU state
 struct cpu {
   uchar apicid;                // Local APIC ID
@@ -8,6 +11,12 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  uint nswitch;                // Context switches into processes
+  volatile uint idle;          // Halted in the scheduler, wake with IRQ_WAKE
+  uint64 swtchtsc;             // TSC when the scheduler last called swtch()
+  struct schedhist hist;       // Latencies of the processes run here
+  volatile uint tlbreq;        // TLB flushes asked for, see tlbshootdown()
+  volatile uint tlbdone;       // and the last one done
 };
 
 extern struct cpu cpus[NCPU];
@@ -33,6 +42,13 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A range of user memory tagged by madvise(); start == end marks a free slot.
+struct vmadvice {
+  uint start;
+  uint end;
+  int advice;                  // MADV_* from mman.h
+};
+
 // Per-process state
 struct proc {
   uint sz;                     // Size of process memory (bytes)
@@ -44,10 +60,44 @@ struct proc {
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
+  struct proc *sqnext;         // Next on chan's sleep queue
+  struct proc **sqprev;        // Link that points at us on the sleep queue
   int killed;                  // If non-zero, have been killed
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  int logres;                  // Log blocks our FS op reserved and has not used
+  int logdepth;                // FS ops we are in, nested ones included
   char name[16];               // Process name (debugging)
+  struct proc *rqnext;         // Next on the run queue while RUNNABLE
+  struct runq *rq;             // Queue holding us, 0 once a CPU took us off
+  int nice;                    // PRIO_MIN (favoured) .. PRIO_MAX
+  int class;                   // SCHED_FAIR or SCHED_PRIO
+  int rqprio;                  // SCHED_PRIO run queue level: nice level, raised by aging
+  uint rqtime;                 // ticks when queued at rqprio
+  struct rbnode rbnode;        // SCHED_FAIR run queue tree node
+  uint64 vruntime;             // Weighted run time, in the frame of the current queue
+  long long vlag;              // vruntime - min_vruntime when last charged or dequeued
+  uint64 exec_start;           // TSC when last charged
+  uint cpumask;                // CPUs we may run on, bit i for cpus[i]
+  int gang;                    // Co-scheduling group, 0 for none
+  int lastcpu;                 // CPU we last ran on, -1 before the first run
+  uint nmigrate;               // Runs on a different CPU than the last one
+  int thread;                 // Made by clone(): shares its parent's pgdir
+  void *ustack;                // Stack given to clone(), returned by join()
+  uint64 readytsc;             // TSC when last made RUNNABLE
+  uint64 dispatchtsc;          // TSC when last dispatched
+  int woken;                   // Made RUNNABLE from SLEEPING or EMBRYO
+  struct schedhist hist;       // Own latencies, also counted per CPU
+  struct vmadvice advice[NMADVISE]; // madvise() hints for swap
+  uint minflt;                 // Faults served by lazyalloc()
+  uint majflt;                 // Faults that read the page back from swap
+  uint cowflt;                 // Copy-on-write breaks
+  uint nswapout;               // Pages written to swap by swap()
+  uint nswapin;                // Pages read back from swap
+  uint wss[NWSSWIN];           // Pages used in the last 2^k kidled passes
+  uint wsssamples;             // kidled passes over this process
+  uint nlocked;                // Pages pinned by mlock()
+  int mlockflags;              // MCL_FUTURE if new pages get locked
 };
 
 
@@ -63,4 +113,8 @@ typedef struct page_data {
     uint la;
 //    pte_t * pte;
 //  };
+  uint cksum;                  // contents checksum from the last ksmd pass
+  BOOL ksm;                    // merged by ksmd, read-only in every mapping
+  BOOL young;                  // PTE_A was harvested by kidled, see pte_young()
+  uint lastref;                // kidled pass that last saw the page accessed
 } page_data_t;
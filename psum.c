@@ -0,0 +1,82 @@
+//
+// Parallel sum: threads made with clone() each add up a slice of one
+// shared array, for 1, 2, 4 and 8 threads.
+// usage: psum [ints] [rounds]
+//
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "date.h"
+
+#define MAXTHREADS 8
+
+static int *array;
+static int nints, rounds, nthreads;
+static uint partial[MAXTHREADS];
+
+static void
+sum(void *arg) {
+  int id = (int) arg;
+  int lo = nints / nthreads * id;
+  int hi = id == nthreads - 1 ? nints : lo + nints / nthreads;
+  uint s = 0;
+
+  for (int r = 0; r < rounds; ++r)
+    for (int i = lo; i < hi; ++i)
+      s += array[i];
+  partial[id] = s;
+}
+
+// b - a in milliseconds
+static int
+elapsed(struct timespec *a, struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1000 +
+         ((int) b->tv_nsec - (int) a->tv_nsec) / 1000000;
+}
+
+int main(int argc, char **argv) {
+  struct timespec t0, t1;
+  uint total, expect = 0;
+  int i, ms, base = 0, fail = 0;
+
+  nints = argc > 1 ? atoi(argv[1]) : 1 << 20;
+  rounds = argc > 2 ? atoi(argv[2]) : 20;
+  if (nints <= 0 || rounds <= 0) {
+    printf(STDERR, "usage: psum [ints] [rounds]\n");
+    exit();
+  }
+  if ((array = malloc(nints * sizeof(int))) == 0) {
+    printf(STDERR, "psum: out of memory\n");
+    exit();
+  }
+  for (i = 0; i < nints; ++i) {
+    array[i] = i;
+    expect += i;
+  }
+  expect *= rounds;
+
+  for (nthreads = 1; nthreads <= MAXTHREADS; nthreads *= 2) {
+    monotime(&t0);
+    for (i = 0; i < nthreads; ++i)
+      if (thread_create(sum, (void *) i) < 0) {
+        printf(STDERR, "psum: thread_create failed\n");
+        exit();
+      }
+    for (i = 0; i < nthreads; ++i)
+      thread_join();
+    monotime(&t1);
+
+    for (total = 0, i = 0; i < nthreads; ++i)
+      total += partial[i];
+    if (total != expect)
+      fail = 1;
+    ms = elapsed(&t0, &t1);
+    if (nthreads == 1)
+      base = ms;
+    printf(STDOUT, "psum: %d threads: %d ms, speedup %d.%d%d\n", nthreads, ms,
+           base * 100 / (ms ? ms : 1) / 100, base * 100 / (ms ? ms : 1) / 10 % 10,
+           base * 100 / (ms ? ms : 1) % 10);
+  }
+  printf(STDOUT, fail ? "psum: wrong sum FAILED\n" : "psum OK\n");
+  exit();
+}
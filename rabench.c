@@ -0,0 +1,77 @@
+//
+// Sequential read throughput of a large file with and without
+// read-ahead. Every pass first drops the file from the buffer cache,
+// so that all of its blocks come from the disk.
+// usage: rabench [passes] [chunk]
+//
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+#include "date.h"
+#include "bcache.h"
+
+#define FILE "rabench.tmp"
+#define FILEBLOCKS 1024
+
+static char buf[4096];
+
+// Read the file passes times with fadvise() hint advice; return KB/s.
+static uint
+run(int passes, int chunk, int advice) {
+  struct timespec t0, t1;
+  uint total = 0, t = 0;
+  int fd, n;
+
+  for (int i = 0; i < passes; ++i) {
+    if ((fd = open(FILE, O_RDONLY)) < 0) {
+      printf(STDERR, "rabench: cannot open %s\n", FILE);
+      exit();
+    }
+    fadvise(fd, FADV_DONTNEED);
+    fadvise(fd, advice);
+    monotime(&t0);
+    while ((n = read(fd, buf, chunk)) > 0)
+      total += n;
+    monotime(&t1);
+    t += elapsedms(&t0, &t1);
+    close(fd);
+  }
+  return t ? total / 1024 * 1000 / t : 0;
+}
+
+int main(int argc, char **argv) {
+  struct bcachestat before, after;
+  int passes, chunk, fd, i;
+  uint sync, ahead;
+
+  passes = argc > 1 ? atoi(argv[1]) : 10;
+  chunk = argc > 2 ? atoi(argv[2]) : 512;
+  if (passes < 1 || chunk < 1 || chunk > sizeof(buf)) {
+    printf(STDERR, "usage: rabench [passes] [chunk]\n");
+    exit();
+  }
+
+  if ((fd = open(FILE, O_CREATE | O_RDWR)) < 0) {
+    printf(STDERR, "rabench: cannot create %s\n", FILE);
+    exit();
+  }
+  memset(buf, 'r', BSIZE);
+  for (i = 0; i < FILEBLOCKS; ++i)
+    write(fd, buf, BSIZE);
+  close(fd);
+
+  sync = run(passes, chunk, FADV_RANDOM);
+  bcachestat(&before);
+  ahead = run(passes, chunk, FADV_NORMAL);
+  bcachestat(&after);
+  unlink(FILE);
+
+  printf(STDOUT, "rabench: %d passes over %d KB in %d-byte reads\n",
+         passes, FILEBLOCKS * BSIZE / 1024, chunk);
+  printf(STDOUT, "no read-ahead: %d.%d MB/s\n", sync / 1024, sync % 1024 * 10 / 1024);
+  printf(STDOUT, "read-ahead:    %d.%d MB/s, %d blocks read ahead\n",
+         ahead / 1024, ahead % 1024 * 10 / 1024, after.readahead - before.readahead);
+  exit();
+}
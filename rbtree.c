@@ -0,0 +1,245 @@
+// Red-black tree, after CLRS chapter 13, with null leaves.
+
+#include "types.h"
+#include "defs.h"
+#include "rbtree.h"
+
+static void
+rotate_left(struct rbroot *root, struct rbnode *x)
+{
+  struct rbnode *y = x->right;
+
+  x->right = y->left;
+  if(y->left)
+    y->left->parent = x;
+  y->parent = x->parent;
+  if(x->parent == 0)
+    root->node = y;
+  else if(x == x->parent->left)
+    x->parent->left = y;
+  else
+    x->parent->right = y;
+  y->left = x;
+  x->parent = y;
+}
+
+static void
+rotate_right(struct rbroot *root, struct rbnode *x)
+{
+  struct rbnode *y = x->left;
+
+  x->left = y->right;
+  if(y->right)
+    y->right->parent = x;
+  y->parent = x->parent;
+  if(x->parent == 0)
+    root->node = y;
+  else if(x == x->parent->right)
+    x->parent->right = y;
+  else
+    x->parent->left = y;
+  y->right = x;
+  x->parent = y;
+}
+
+// Hang n at *link, a null child pointer of parent (0 for an empty tree).
+void
+rb_link(struct rbnode *n, struct rbnode *parent, struct rbnode **link)
+{
+  n->parent = parent;
+  n->left = n->right = 0;
+  n->red = 1;
+  *link = n;
+}
+
+// Restore the red-black properties after rb_link(n).
+void
+rb_insert_fixup(struct rbroot *root, struct rbnode *n)
+{
+  struct rbnode *p, *g, *u;
+
+  while((p = n->parent) != 0 && p->red){
+    g = p->parent;
+    if(p == g->left){
+      u = g->right;
+      if(u && u->red){
+        p->red = u->red = 0;
+        g->red = 1;
+        n = g;
+        continue;
+      }
+      if(n == p->right){
+        rotate_left(root, p);
+        n = p;
+        p = n->parent;
+      }
+      p->red = 0;
+      g->red = 1;
+      rotate_right(root, g);
+    } else {
+      u = g->left;
+      if(u && u->red){
+        p->red = u->red = 0;
+        g->red = 1;
+        n = g;
+        continue;
+      }
+      if(n == p->left){
+        rotate_right(root, p);
+        n = p;
+        p = n->parent;
+      }
+      p->red = 0;
+      g->red = 1;
+      rotate_left(root, g);
+    }
+  }
+  root->node->red = 0;
+}
+
+static void
+transplant(struct rbroot *root, struct rbnode *u, struct rbnode *v)
+{
+  if(u->parent == 0)
+    root->node = v;
+  else if(u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if(v)
+    v->parent = u->parent;
+}
+
+static int
+isred(struct rbnode *n)
+{
+  return n && n->red;
+}
+
+// x (possibly null) carries an extra black; xp is its parent.
+static void
+erase_fixup(struct rbroot *root, struct rbnode *x, struct rbnode *xp)
+{
+  struct rbnode *w;
+
+  while(x != root->node && !isred(x)){
+    if(x == xp->left){
+      w = xp->right;
+      if(w->red){
+        w->red = 0;
+        xp->red = 1;
+        rotate_left(root, xp);
+        w = xp->right;
+      }
+      if(!isred(w->left) && !isred(w->right)){
+        w->red = 1;
+        x = xp;
+        xp = x->parent;
+      } else {
+        if(!isred(w->right)){
+          w->left->red = 0;
+          w->red = 1;
+          rotate_right(root, w);
+          w = xp->right;
+        }
+        w->red = xp->red;
+        xp->red = 0;
+        if(w->right)
+          w->right->red = 0;
+        rotate_left(root, xp);
+        x = root->node;
+      }
+    } else {
+      w = xp->left;
+      if(w->red){
+        w->red = 0;
+        xp->red = 1;
+        rotate_right(root, xp);
+        w = xp->left;
+      }
+      if(!isred(w->left) && !isred(w->right)){
+        w->red = 1;
+        x = xp;
+        xp = x->parent;
+      } else {
+        if(!isred(w->left)){
+          w->right->red = 0;
+          w->red = 1;
+          rotate_left(root, w);
+          w = xp->left;
+        }
+        w->red = xp->red;
+        xp->red = 0;
+        if(w->left)
+          w->left->red = 0;
+        rotate_right(root, xp);
+        x = root->node;
+      }
+    }
+  }
+  if(x)
+    x->red = 0;
+}
+
+void
+rb_erase(struct rbroot *root, struct rbnode *z)
+{
+  struct rbnode *x, *xp, *y;
+  int yred;
+
+  yred = z->red;
+  if(z->left == 0){
+    x = z->right;
+    xp = z->parent;
+    transplant(root, z, z->right);
+  } else if(z->right == 0){
+    x = z->left;
+    xp = z->parent;
+    transplant(root, z, z->left);
+  } else {
+    for(y = z->right; y->left; y = y->left)
+      ;
+    yred = y->red;
+    x = y->right;
+    if(y->parent == z){
+      xp = y;
+    } else {
+      xp = y->parent;
+      transplant(root, y, y->right);
+      y->right = z->right;
+      y->right->parent = y;
+    }
+    transplant(root, z, y);
+    y->left = z->left;
+    y->left->parent = y;
+    y->red = z->red;
+  }
+  if(!yred)
+    erase_fixup(root, x, xp);
+}
+
+struct rbnode*
+rb_first(struct rbroot *root)
+{
+  struct rbnode *n = root->node;
+
+  if(n)
+    while(n->left)
+      n = n->left;
+  return n;
+}
+
+struct rbnode*
+rb_next(struct rbnode *n)
+{
+  struct rbnode *p;
+
+  if(n->right){
+    for(n = n->right; n->left; n = n->left)
+      ;
+    return n;
+  }
+  while((p = n->parent) != 0 && n == p->right)
+    n = p;
+  return p;
+}
@@ -0,0 +1,27 @@
+#ifndef XV6_PUBLIC_RBTREE_H
+#define XV6_PUBLIC_RBTREE_H
+
+// Intrusive red-black tree. Embed a struct rbnode in the object, find the
+// insertion point by walking from root->node with the caller's ordering,
+// then rb_link() and rb_insert_fixup().
+struct rbnode {
+  struct rbnode *parent;
+  struct rbnode *left;
+  struct rbnode *right;
+  int red;
+};
+
+struct rbroot {
+  struct rbnode *node;
+};
+
+#define rb_entry(ptr, type, member) \
+  ((type*)((char*)(ptr) - (uint)&((type*)0)->member))
+
+void            rb_link(struct rbnode*, struct rbnode*, struct rbnode**);
+void            rb_insert_fixup(struct rbroot*, struct rbnode*);
+void            rb_erase(struct rbroot*, struct rbnode*);
+struct rbnode*  rb_first(struct rbroot*);
+struct rbnode*  rb_next(struct rbnode*);
+
+#endif //XV6_PUBLIC_RBTREE_H
@@ -0,0 +1,76 @@
+//
+// Scheduler scalability: N CPU-bound and N yield-heavy processes,
+// reporting context switches per second on every CPU.
+// usage: schedbench [nproc] [ticks]
+//
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "stateinfo.h"
+
+#define TICKS_PER_SEC 100
+
+static void
+spin(int until) {
+  volatile uint x = 0;
+
+  while (uptime() < until)
+    for (int i = 0; i < 10000; ++i)
+      x += i;
+  exit();
+}
+
+static void
+yielder(int until) {
+  while (uptime() < until)
+    yield();
+  exit();
+}
+
+int main(int argc, char **argv) {
+  int n = argc > 1 ? atoi(argv[1]) : 4;
+  int duration = argc > 2 ? atoi(argv[2]) : 500;
+  struct procinfo *pi_arr = malloc(NPROC * sizeof(struct procinfo));
+  struct cpuinfo *before = malloc(NCPU * sizeof(struct cpuinfo));
+  struct cpuinfo *after = malloc(NCPU * sizeof(struct cpuinfo));
+  int ncpu, start, end, i;
+  uint total = 0;
+
+  if (n < 1 || 2 * n + 3 > NPROC || duration <= 0) {
+    printf(STDERR, "usage: schedbench [nproc] [ticks]\n");
+    exit();
+  }
+  if ((ncpu = state(&pi_arr, &before)) < 0) {
+    printf(STDERR, "schedbench: state failed\n");
+    exit();
+  }
+
+  start = uptime();
+  end = start + duration;
+  for (i = 0; i < 2 * n; ++i) {
+    int pid = fork();
+    if (pid < 0) {
+      printf(STDERR, "schedbench: fork failed\n");
+      break;
+    }
+    if (pid == 0) {
+      if (i % 2)
+        yielder(end);
+      spin(end);
+    }
+  }
+  for (; i > 0; --i)
+    wait();
+  end = uptime();
+  state(&pi_arr, &after);
+
+  printf(STDOUT, "schedbench: %d cpu-bound + %d yielding procs, %d ticks\n", n, n, end - start);
+  for (i = 0; i < ncpu; ++i) {
+    uint sw = after[i].nswitch - before[i].nswitch;
+    total += sw;
+    printf(STDOUT, "cpu %d: %u switches, %u/s\n", after[i].id, sw,
+           sw * TICKS_PER_SEC / (end - start));
+  }
+  printf(STDOUT, "total: %u switches, %u/s\n", total, total * TICKS_PER_SEC / (end - start));
+  exit();
+}
@@ -0,0 +1,66 @@
+//
+// Print the scheduler latency histograms of the whole system or of
+// one process: run-queue delay after a wakeup and after preemption,
+// time slice length, and the cost of the context switch.
+// usage: schedlat [pid]
+//
+#include "types.h"
+#include "user.h"
+#include "schedstat.h"
+
+#define BARWIDTH 40
+
+static uint unitns;  // nanoseconds per 2^LATSHIFT cycles
+
+// Lower bound of bucket i in microseconds, without 64-bit arithmetic.
+static uint
+lowus(int i) {
+  if (i == 0)
+    return 0;
+  if (i - 1 < 10)
+    return (unitns << (i - 1)) / 1000;
+  return (unitns << (i - 11)) * 128 / 125;  // * 1024 / 1000
+}
+
+static void
+show(char *title, uint *h) {
+  uint n = 0, max = 0;
+  int i, j, lo = NLATBUCKET, hi = -1;
+
+  for (i = 0; i < NLATBUCKET; ++i) {
+    n += h[i];
+    if (h[i] > max)
+      max = h[i];
+    if (h[i] && i < lo)
+      lo = i;
+    if (h[i])
+      hi = i;
+  }
+  printf(STDOUT, "%s: %u samples\n", title, n);
+  for (i = lo; i <= hi; ++i) {
+    printf(STDOUT, "  %8u us %s %8u ", lowus(i), i == NLATBUCKET - 1 ? "+ " : "..", h[i]);
+    for (j = 0; j < (h[i] * BARWIDTH + max - 1) / max; ++j)
+      printf(STDOUT, "*");
+    printf(STDOUT, "\n");
+  }
+}
+
+int main(int argc, char **argv) {
+  struct schedhist h;
+  int pid = argc > 1 ? atoi(argv[1]) : -1;
+
+  if (schedstat(pid, &h) < 0) {
+    printf(STDERR, "schedlat: no pid %d\n", pid);
+    exit();
+  }
+  unitns = (1000000 << LATSHIFT) / h.tsckhz;
+  if (pid == -1)
+    printf(STDOUT, "all cpus, tsc %u kHz\n", h.tsckhz);
+  else
+    printf(STDOUT, "pid %d, tsc %u kHz\n", pid, h.tsckhz);
+  show("wakeup latency", h.wakeup);
+  show("requeue latency", h.requeue);
+  show("time slice", h.slice);
+  show("context switch", h.swtch);
+  exit();
+}
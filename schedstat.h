@@ -0,0 +1,19 @@
+#ifndef XV6_PUBLIC_SCHEDSTAT_H
+#define XV6_PUBLIC_SCHEDSTAT_H
+
+// Scheduler latency histograms, returned by schedstat().
+// Bucket 0 counts intervals below 2^LATSHIFT TSC cycles, bucket i
+// those in [2^(LATSHIFT+i-1), 2^(LATSHIFT+i)); the last one also
+// counts everything longer.
+#define LATSHIFT    10
+#define NLATBUCKET  24
+
+struct schedhist {
+  uint wakeup[NLATBUCKET];   // woken or forked until dispatched
+  uint requeue[NLATBUCKET];  // preempted or yielded until dispatched again
+  uint slice[NLATBUCKET];    // dispatched until it gave up the CPU
+  uint swtch[NLATBUCKET];    // scheduler's swtch() until the process runs
+  uint tsckhz;               // TSC rate, to turn buckets into time
+};
+
+#endif //XV6_PUBLIC_SCHEDSTAT_H
@@ -14,7 +14,8 @@ int main(int argv, char **argc) {
     struct procinfo *pi_arr = malloc(NPROC * sizeof (struct procinfo));
     struct cpuinfo *cpui_arr = malloc(NCPU * sizeof (struct cpuinfo));
 
-    if (state(&pi_arr, &cpui_arr) < 0)
+    int ncpu;
+    if ((ncpu = state(&pi_arr, &cpui_arr)) < 0)
     {
         printf(STDERR, "*** an error occurred\n");
         exit();
@@ -24,8 +25,9 @@ int main(int argv, char **argc) {
         if (pi_arr[i].pid == 0 && pi_arr[i].size == 0) { // if no mem the process probably does not exist
             break;
         }
-        printf(STDOUT, "pid:%2d\tstate:%s\tname:%4s\tmemory:%9u\tnfiles:%02u\t",
-               pi_arr[i].pid, pi_arr[i].state, pi_arr[i].name, pi_arr[i].size, pi_arr[i].file_count);
+        printf(STDOUT, "pid:%2d\tstate:%s\tname:%4s\tnice:%d\tmemory:%9u\tnfiles:%02u\t",
+               pi_arr[i].pid, pi_arr[i].state, pi_arr[i].name, pi_arr[i].nice, pi_arr[i].size,
+               pi_arr[i].file_count);
         printf(STDOUT, "inodes:(");
         for (int j = 0; j < NOFILE; ++j) {
             if(pi_arr[i].inodeIds[j] == 0)
@@ -35,12 +37,16 @@ int main(int argv, char **argc) {
         }
 //        printf(STDOUT, ")\t");
         printf(STDOUT, ")\n");
+        printf(STDOUT, "\trss:%u\tswapped:%u\tlocked:%u\tminflt:%u\tmajflt:%u\tcowflt:%u\tswapout:%u\tswapin:%u\n",
+               pi_arr[i].resident, pi_arr[i].swapped, pi_arr[i].locked, pi_arr[i].minflt,
+               pi_arr[i].majflt, pi_arr[i].cowflt, pi_arr[i].swapout, pi_arr[i].swapin);
+        printf(STDOUT, "\tcpus:%x\tlastcpu:%d\tmigrations:%u\n",
+               pi_arr[i].cpumask, pi_arr[i].lastcpu, pi_arr[i].migrations);
     }
 
-    for (int i = 0; i < NCPU; ++i) {
-        if (cpui_arr[i].pid == 0 && cpui_arr[i].id == 0 && i!=0)
-            break;
-        printf(STDOUT, "cpu:%d\tpid:%d\n", cpui_arr[i].id, cpui_arr[i].pid);
+    for (int i = 0; i < ncpu; ++i) {
+        printf(STDOUT, "cpu:%d\tpid:%d\tswitches:%u\trunq:%u\n", cpui_arr[i].id, cpui_arr[i].pid,
+               cpui_arr[i].nswitch, cpui_arr[i].runqlen);
     }
     free(pi_arr);
     free(cpui_arr);
@@ -6,16 +6,39 @@
 #define XV6_PUBLIC_STATEINFO_H
 typedef struct cpuinfo{
     int id;
-    int pid;
+    int pid;        // running process, 0 when idle
+    uint nswitch;   // context switches into processes
+    uint runqlen;   // runnable processes queued on this CPU
 } cpuinfo_t;
 typedef struct procinfo{
     int pid;
+    int nice;
+    int class;      // SCHED_FAIR or SCHED_PRIO
+    uint cpumask;   // CPUs it may run on
+    int lastcpu;    // index of the CPU it last ran on, -1 if none
+    uint migrations; // runs on a different CPU than the previous one
     char state[16];
     char name[16];
     uint size;
+    uint resident;   // bytes of user memory present in RAM
+    uint swapped;    // bytes of user memory in the swap file
+    uint locked;     // bytes pinned by mlock()
+    uint minflt;     // lazy allocation faults
+    uint majflt;     // swap-in faults
+    uint cowflt;     // copy-on-write breaks
+    uint swapout;    // pages swapped out
+    uint swapin;     // pages swapped in, including readahead
     uint file_count;
     int inodeIds[NOFILE];
 } procinfo_t;
+typedef struct wssinfo {
+    int pid;
+    uint interval;          // ticks between kidled samples
+    uint samples;           // samples taken of this process
+    uint window[NWSSWIN];   // window lengths in ticks
+    uint wss[NWSSWIN];      // bytes used within each window
+    uint resident;          // bytes present in RAM
+} wssinfo_t;
 struct stateinfo {
     procinfo_t *proc[NPROC];
     cpuinfo_t *cpuinfo[NCPU];
@@ -136,6 +136,33 @@ extern int sys_date(void);
 extern int sys_toggleLogging(void);
 extern int sys_state(void);
 extern int sys_swap(void);
+extern int sys_madvise(void);
+extern int sys_mlock(void);
+extern int sys_munlock(void);
+extern int sys_mlockall(void);
+extern int sys_munlockall(void);
+extern int sys_ksmstat(void);
+extern int sys_wss(void);
+extern int sys_idleinterval(void);
+extern int sys_yield(void);
+extern int sys_setpriority(void);
+extern int sys_getpriority(void);
+extern int sys_nice(void);
+extern int sys_setclass(void);
+extern int sys_nanosleep(void);
+extern int sys_monotime(void);
+extern int sys_sched_setaffinity(void);
+extern int sys_sched_getaffinity(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futex(void);
+extern int sys_schedstat(void);
+extern int sys_setgang(void);
+extern int sys_bcachestat(void);
+extern int sys_fadvise(void);
+extern int sys_sync(void);
+extern int sys_fsync(void);
+extern int sys_fruns(void);
 
 
 
@@ -166,6 +193,33 @@ static int (*syscalls[])(void) = {
 [SYS_toggleLogging]    sys_toggleLogging,
 [SYS_state]            sys_state,
 [SYS_swap]             sys_swap,
+[SYS_madvise]          sys_madvise,
+[SYS_mlock]            sys_mlock,
+[SYS_munlock]          sys_munlock,
+[SYS_mlockall]         sys_mlockall,
+[SYS_munlockall]       sys_munlockall,
+[SYS_ksmstat]          sys_ksmstat,
+[SYS_wss]              sys_wss,
+[SYS_idleinterval]     sys_idleinterval,
+[SYS_yield]            sys_yield,
+[SYS_setpriority]      sys_setpriority,
+[SYS_getpriority]      sys_getpriority,
+[SYS_nice]             sys_nice,
+[SYS_setclass]         sys_setclass,
+[SYS_nanosleep]        sys_nanosleep,
+[SYS_monotime]         sys_monotime,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_clone]            sys_clone,
+[SYS_join]             sys_join,
+[SYS_futex]            sys_futex,
+[SYS_schedstat]        sys_schedstat,
+[SYS_setgang]          sys_setgang,
+[SYS_bcachestat]       sys_bcachestat,
+[SYS_fadvise]          sys_fadvise,
+[SYS_sync]             sys_sync,
+[SYS_fsync]            sys_fsync,
+[SYS_fruns]            sys_fruns,
 
 
 };
@@ -196,6 +250,33 @@ static char* syscall_names[] = {
         [SYS_toggleLogging]    "toggleLogging",
         [SYS_state]    "state",
         [SYS_swap]     "swap",
+        [SYS_madvise]  "madvise",
+        [SYS_mlock]    "mlock",
+        [SYS_munlock]  "munlock",
+        [SYS_mlockall] "mlockall",
+        [SYS_munlockall] "munlockall",
+        [SYS_ksmstat]  "ksmstat",
+        [SYS_wss]      "wss",
+        [SYS_idleinterval] "idleinterval",
+        [SYS_yield]    "yield",
+        [SYS_setpriority] "setpriority",
+        [SYS_getpriority] "getpriority",
+        [SYS_nice]     "nice",
+        [SYS_setclass] "setclass",
+        [SYS_nanosleep] "nanosleep",
+        [SYS_monotime] "monotime",
+        [SYS_sched_setaffinity] "sched_setaffinity",
+        [SYS_sched_getaffinity] "sched_getaffinity",
+        [SYS_clone] "clone",
+        [SYS_join] "join",
+        [SYS_futex] "futex",
+        [SYS_schedstat] "schedstat",
+        [SYS_setgang] "setgang",
+        [SYS_bcachestat] "bcachestat",
+        [SYS_fadvise] "fadvise",
+        [SYS_sync] "sync",
+        [SYS_fsync] "fsync",
+        [SYS_fruns] "fruns",
 
 
 
@@ -23,4 +23,31 @@
 #define SYS_date   22
 #define SYS_toggleLogging  23
 #define SYS_state  24
-#define SYS_swap   25
\ No newline at end of file
+#define SYS_swap   25
+#define SYS_madvise 26
+#define SYS_mlock  27
+#define SYS_munlock 28
+#define SYS_mlockall 29
+#define SYS_munlockall 30
+#define SYS_ksmstat 31
+#define SYS_wss    32
+#define SYS_idleinterval 33
+#define SYS_yield  34
+#define SYS_setpriority 35
+#define SYS_getpriority 36
+#define SYS_nice   37
+#define SYS_setclass 38
+#define SYS_nanosleep 39
+#define SYS_monotime 40
+#define SYS_sched_setaffinity 41
+#define SYS_sched_getaffinity 42
+#define SYS_clone  43
+#define SYS_join   44
+#define SYS_futex  45
+#define SYS_schedstat 46
+#define SYS_setgang 47
+#define SYS_bcachestat 48
+#define SYS_fadvise 49
+#define SYS_sync   50
+#define SYS_fsync  51
+#define SYS_fruns  52
\ No newline at end of file
@@ -16,6 +16,7 @@
 #include "file.h"
 #include "fcntl.h"
 #include "stateinfo.h"
+#include "bcache.h"
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
 int LOG_SYSCALLS = 0;
@@ -126,7 +127,7 @@ sys_link(void)
   if(argstr(0, &old) < 0 || argstr(1, &new) < 0)
     return -1;
 
-  begin_op();
+  begin_op(MAXOPBLOCKS);
   if((ip = namei(old)) == 0){
     end_op();
     return -1;
@@ -194,7 +195,7 @@ sys_unlink(void)
   if(argstr(0, &path) < 0)
     return -1;
 
-  begin_op();
+  begin_op(MAXOPBLOCKS);
   if((dp = nameiparent(path, name)) == 0){
     end_op();
     return -1;
@@ -241,7 +242,7 @@ bad:
 }
 
 static struct inode*
-create(char *path, short type, short major, short minor)
+create(char *path, short type, short major, short minor, uint flags)
 {
   struct inode *ip, *dp;
   char name[DIRSIZ];
@@ -266,6 +267,7 @@ create(char *path, short type, short major, short minor)
   ip->major = major;
   ip->minor = minor;
   ip->nlink = 1;
+  ip->flags = flags;
   iupdate(ip);
 
   if(type == T_DIR){  // Create . and .. entries.
@@ -295,10 +297,10 @@ sys_open(void)
   if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
     return -1;
 
-  begin_op();
+  begin_op(MAXOPBLOCKS);
 
   if(omode & O_CREATE){
-    ip = create(path, T_FILE, 0, 0);
+    ip = create(path, T_FILE, 0, 0, omode & O_BLOCKMAP ? 0 : I_EXTENTS);
     if(ip == NULL ){
       end_op();
       return -1;
@@ -340,8 +342,8 @@ sys_mkdir(void)
   char *path;
   struct inode *ip;
 
-  begin_op();
-  if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
+  begin_op(MAXOPBLOCKS);
+  if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, 0, 0, 0)) == 0){
     end_op();
     return -1;
   }
@@ -357,11 +359,11 @@ sys_mknod(void)
   char *path;
   int major, minor;
 
-  begin_op();
+  begin_op(MAXOPBLOCKS);
   if((argstr(0, &path)) < 0 ||
      argint(1, &major) < 0 ||
      argint(2, &minor) < 0 ||
-     (ip = create(path, T_DEV, major, minor)) == 0){
+     (ip = create(path, T_DEV, major, minor, 0)) == 0){
     end_op();
     return -1;
   }
@@ -377,7 +379,7 @@ sys_chdir(void)
   struct inode *ip;
   struct proc *curproc = myproc();
   
-  begin_op();
+  begin_op(putblocks());
   if(argstr(0, &path) < 0 || (ip = namei(path)) == 0){
     end_op();
     return -1;
@@ -465,8 +467,7 @@ sys_state(void)
         return -1;
 
 //    cprintf("breaks here\n");
-    procdumpWrite(*pi_arr, *cpui_arr);
-    return 0;
+    return procdumpWrite(*pi_arr, *cpui_arr);  // number of cpus
 }
 
 int
@@ -474,4 +475,59 @@ sys_swap(void)
 {
   swap();
   return 0;
-}
\ No newline at end of file
+}
+
+int
+sys_bcachestat(void)
+{
+  struct bcachestat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  bstat(st);
+  return 0;
+}
+
+int
+sys_fadvise(void)
+{
+  struct file *f;
+  int advice;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &advice) < 0)
+    return -1;
+  return fileadvise(f, advice);
+}
+
+// Count the contiguous runs of disk blocks holding the file's data.
+int
+sys_fruns(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return fileruns(f);
+}
+
+// Write every committed block to its home location.
+int
+sys_sync(void)
+{
+  logflush();
+  return 0;
+}
+
+// Wait until the file's updates are committed to the log; logd
+// commits all of them, so the file's are not singled out.
+int
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  if(f->type == FD_INODE)
+    logcommit();
+  return 0;
+}
@@ -6,6 +6,9 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "ksm.h"
+#include "stateinfo.h"
+#include "futex.h"
 
 int
 sys_fork(void)
@@ -63,37 +66,259 @@ sys_sbrk(void)
 }
 
 int
-sys_sleep(void)
+sys_madvise(void)
+{
+  int addr, len, advice;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &advice) < 0)
+    return -1;
+  if(len < 0)
+    return -1;
+  return madvise(myproc(), addr, len, advice);
+}
+
+int
+sys_mlock(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len < 0)
+    return -1;
+  return mlock(myproc(), addr, len);
+}
+
+int
+sys_munlock(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len < 0)
+    return -1;
+  return munlock(myproc(), addr, len);
+}
+
+int
+sys_mlockall(void)
+{
+  int flags;
+
+  if(argint(0, &flags) < 0)
+    return -1;
+  return mlockall(myproc(), flags);
+}
+
+int
+sys_munlockall(void)
+{
+  return munlockall(myproc());
+}
+
+int
+sys_ksmstat(void)
+{
+  struct ksmstat *ust, st;
+
+  if(argptr(0, (void*)&ust, sizeof(*ust)) < 0)
+    return -1;
+  ksmgetstat(&st);
+  *ust = st;  // may fault: not under ptable.lock
+  return 0;
+}
+
+int
+sys_wss(void)
+{
+  struct wssinfo *uwi, wi;
+  int pid;
+
+  if(argint(0, &pid) < 0 || argptr(1, (void*)&uwi, sizeof(*uwi)) < 0)
+    return -1;
+  if(wssget(pid, &wi) < 0)
+    return -1;
+  *uwi = wi;
+  return 0;
+}
+
+int
+sys_idleinterval(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
+  return setidleinterval(n);
+}
+
+int
+sys_setpriority(void)
+{
+  int pid, nice;
+
+  if(argint(0, &pid) < 0 || argint(1, &nice) < 0)
+    return -1;
+  return setpriority(pid, nice);
+}
+
+int
+sys_setclass(void)
+{
+  int pid, cls;
+
+  if(argint(0, &pid) < 0 || argint(1, &cls) < 0)
+    return -1;
+  return setclass(pid, cls);
+}
+
+int
+sys_getpriority(void)
+{
+  int pid, *nice;
+
+  if(argint(0, &pid) < 0 || argptr(1, (void*)&nice, sizeof(*nice)) < 0)
+    return -1;
+  return getpriority(pid, nice);
+}
+
+int
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
+int
+sys_sched_getaffinity(void)
+{
+  int pid;
+  uint *mask;
+
+  if(argint(0, &pid) < 0 || argptr(1, (void*)&mask, sizeof(*mask)) < 0)
+    return -1;
+  return getaffinity(pid, mask);
+}
+
+int
+sys_clone(void)
+{
+  int fn, arg, stack;
+
+  if(argint(0, &fn) < 0 || argint(1, &arg) < 0 || argint(2, &stack) < 0)
+    return -1;
+  return clone((void (*)(void*))fn, (void*)arg, (void*)stack);
+}
+
+int
+sys_join(void)
+{
+  void **stack;
+
+  if(argptr(0, (void*)&stack, sizeof(*stack)) < 0)
+    return -1;
+  return join(stack);
+}
+
+int
+sys_futex(void)
+{
+  int addr, op, val;
+
+  if(argint(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  switch(op){
+  case FUTEX_WAIT:
+    return futexwait(addr, val);
+  case FUTEX_WAKE:
+    return futexwake(addr, val);
   }
-  release(&tickslock);
+  return -1;
+}
+
+int
+sys_schedstat(void)
+{
+  int pid;
+  struct schedhist *uh, h;
+
+  if(argint(0, &pid) < 0 || argptr(1, (void*)&uh, sizeof(*uh)) < 0)
+    return -1;
+  if(schedstat(pid, &h) < 0)
+    return -1;
+  *uh = h;
   return 0;
 }
 
+int
+sys_setgang(void)
+{
+  int pid, gang;
+
+  if(argint(0, &pid) < 0 || argint(1, &gang) < 0)
+    return -1;
+  return setgang(pid, gang);
+}
+
+// Add inc to the caller's nice value and return the new one.
+int
+sys_nice(void)
+{
+  int inc;
+  struct proc *curproc = myproc();
+
+  if(argint(0, &inc) < 0)
+    return -1;
+  setpriority(curproc->pid, curproc->nice + inc);
+  return curproc->nice;
+}
+
+int
+sys_yield(void)
+{
+  yield();
+  return 0;
+}
+
+int
+sys_sleep(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  if(n <= 0)
+    return 0;
+  return ticksleep(n);
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 int
 sys_uptime(void)
 {
-  uint xticks;
+  return tickupdate();
+}
+
+int
+sys_nanosleep(void)
+{
+  struct timespec *req;
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  if(argptr(0, (void*)&req, sizeof(*req)) < 0 || req->tv_nsec >= 1000000000)
+    return -1;
+  return timersleep(rdtsc() + timespec2tsc(req));
+}
+
+int
+sys_monotime(void)
+{
+  struct timespec *ts;
+
+  if(argptr(0, (void*)&ts, sizeof(*ts)) < 0)
+    return -1;
+  monotime(ts);
+  return 0;
 }
 
 int
@@ -0,0 +1,62 @@
+//
+// Run a command on a set of CPUs, or show or change the CPUs of a
+// running process. Masks are hex (bit i for CPU i) or decimal.
+// usage: taskset mask cmd [arg ...]
+//        taskset -p pid [mask]
+//
+#include "types.h"
+#include "user.h"
+
+static uint
+parsemask(char *s) {
+  uint m = 0;
+
+  if (s[0] != '0' || (s[1] != 'x' && s[1] != 'X'))
+    return atoi(s);
+  for (s += 2; *s; ++s) {
+    if (*s >= '0' && *s <= '9')
+      m = m * 16 + *s - '0';
+    else if (*s >= 'a' && *s <= 'f')
+      m = m * 16 + *s - 'a' + 10;
+    else if (*s >= 'A' && *s <= 'F')
+      m = m * 16 + *s - 'A' + 10;
+    else
+      break;
+  }
+  return m;
+}
+
+static void
+usage(void) {
+  printf(STDERR, "usage: taskset mask cmd [arg ...]\n"
+                 "       taskset -p pid [mask]\n");
+  exit();
+}
+
+int main(int argc, char **argv) {
+  uint mask;
+  int pid;
+
+  if (argc >= 3 && strcmp(argv[1], "-p") == 0) {
+    pid = atoi(argv[2]);
+    if (argc > 3 && sched_setaffinity(pid, parsemask(argv[3])) < 0) {
+      printf(STDERR, "taskset: cannot set pid %d to %s\n", pid, argv[3]);
+      exit();
+    }
+    if (sched_getaffinity(pid, &mask) < 0) {
+      printf(STDERR, "taskset: no pid %d\n", pid);
+      exit();
+    }
+    printf(STDOUT, "pid %d: cpus 0x%x\n", pid, mask);
+    exit();
+  }
+  if (argc < 3)
+    usage();
+  if (sched_setaffinity(0, parsemask(argv[1])) < 0) {
+    printf(STDERR, "taskset: bad mask %s\n", argv[1]);
+    exit();
+  }
+  exec(argv[2], argv + 2);
+  printf(STDERR, "taskset: exec %s failed\n", argv[2]);
+  exit();
+}
@@ -0,0 +1,350 @@
+// Timers and tickless idle.
+//
+// timerinit() measures the TSC and LAPIC timer rates against the PIT.
+// Every CPU keeps its pending timers in a binary min-heap ordered by TSC
+// deadline and runs its LAPIC timer in one-shot mode, armed for the first
+// expiry. While the CPU runs a process it also arms the next scheduler
+// tick, so that the process gets preempted; an idle CPU only wakes up
+// for its timers and halts in between.
+//
+// Nobody counts ticks in the timer interrupt any more: whichever CPU
+// takes an interrupt catches ticks up with the TSC.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "date.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "timer.h"
+
+#define NTIMER   (NPROC + 8)    // every process plus the kernel threads
+#define NEVER    (~0ULL)
+#define PIT_HZ   1193182        // PIT input clock
+#define CALHZ    100            // calibration window: 1/CALHZ s
+#define NSEC     1000000000
+
+struct timerq {
+  struct spinlock lock;
+  struct timer *heap[NTIMER];
+  int n;
+  int ticking;                 // arm scheduler ticks: a process is running
+  uint64 tickdue;              // when the running process's next tick is due
+  uint64 deadline;             // what the LAPIC timer is armed for
+};
+
+static struct timerq timerqs[NCPU];
+
+static uint cyclesperms;       // TSC cycles per millisecond: its rate in kHz,
+                               // which fits 32 bits where the Hz may not
+static uint64 tickcycles;      // TSC cycles per tick
+static uint64 lapicmult;       // LAPIC counts per TSC cycle, 32.32 fixed point
+static uint maxdelta;          // longest interval tsc2lapic() can convert
+static uint64 boottsc;
+static uint64 nexttick;        // TSC of the next tick, under tickslock
+
+// 64-by-32 bit division: the kernel is not linked with libgcc.
+static uint64
+div64(uint64 n, uint d, uint *rem)
+{
+  uint hi = n >> 32, lo = n, q;
+
+  asm("divl %4" : "=a" (q), "=d" (lo) : "a" (lo), "d" (hi % d), "rm" (d));
+  if(rem)
+    *rem = lo;
+  return ((uint64)(hi / d) << 32) | q;
+}
+
+// Count 1/CALHZ s on PIT channel 2 and see how far the TSC
+// and the LAPIC timer get meanwhile.
+static void
+calibrate(void)
+{
+  uint latch = PIT_HZ / CALHZ, l0, l1;
+  uint64 t0, t1;
+
+  outb(0x61, (inb(0x61) & ~0x02) | 0x01);  // gate channel 2 on, speaker off
+  outb(0x43, 0xB0);                        // channel 2, lo/hi byte, mode 0
+  outb(0x42, latch & 0xFF);
+  outb(0x42, latch >> 8);
+  lapiconeshot(0xFFFFFFFF);
+  l0 = lapiccount();
+  t0 = rdtsc();
+  while((inb(0x61) & 0x20) == 0)           // channel 2 output goes high
+    ;
+  t1 = rdtsc();
+  l1 = lapiccount();
+  lapiconeshot(0);
+
+  if(t1 - t0 == 0 || t1 - t0 > 0xFFFFFFFF || l0 == l1)
+    panic("timerinit: calibration");
+  cyclesperms = div64((t1 - t0) * CALHZ, 1000, 0);
+  cprintf("timer: tsc %d kHz, lapic %d kHz\n",
+          cyclesperms, (l0 - l1) * CALHZ / 1000);
+  tickcycles = div64((uint64)cyclesperms * 1000, HZ, 0);
+  lapicmult = div64((uint64)(l0 - l1) << 32, t1 - t0, 0);
+  maxdelta = 0xFFFFFFFF / ((uint)(lapicmult >> 32) + 1);
+}
+
+void
+timerinit(void)
+{
+  struct timerq *q;
+
+  for(q = timerqs; q < &timerqs[NCPU]; q++){
+    initlock(&q->lock, "timerq");
+    q->deadline = NEVER;
+  }
+  calibrate();
+  boottsc = rdtsc();
+  nexttick = boottsc + tickcycles;
+}
+
+// LAPIC timer counts for delta TSC cycles; longer intervals
+// are cut short and the timer is re-armed when it fires.
+static uint
+tsc2lapic(uint64 delta)
+{
+  uint count;
+
+  if(delta > maxdelta)
+    delta = maxdelta;
+  count = (delta * lapicmult) >> 32;
+  return count ? count : 1;
+}
+
+uint64
+timespec2tsc(struct timespec *ts)
+{
+  return (uint64)ts->tv_sec * 1000 * cyclesperms +
+         div64((uint64)ts->tv_nsec * cyclesperms, NSEC / 1000, 0);
+}
+
+void
+tsc2timespec(uint64 tsc, struct timespec *ts)
+{
+  uint rem, ms;
+  uint64 msecs;
+
+  msecs = div64(tsc, cyclesperms, &rem);
+  ts->tv_sec = div64(msecs, 1000, &ms);
+  ts->tv_nsec = ms * (NSEC / 1000) + div64((uint64)rem * (NSEC / 1000), cyclesperms, 0);
+}
+
+uint
+tsckhz(void)
+{
+  return cyclesperms;
+}
+
+// Time since timerinit().
+void
+monotime(struct timespec *ts)
+{
+  tsc2timespec(rdtsc() - boottsc, ts);
+}
+
+// Advance ticks to the TSC and return it.
+uint
+tickupdate(void)
+{
+  uint64 now = rdtsc();
+  uint t;
+
+  acquire(&tickslock);
+  while(now >= nexttick){
+    ticks++;
+    nexttick += tickcycles;
+  }
+  t = ticks;
+  release(&tickslock);
+  return t;
+}
+
+// Program this CPU's LAPIC timer for q's first timer or, if sooner
+// and a process is running, its next tick. Caller holds q->lock.
+static void
+timerarm(struct timerq *q)
+{
+  uint64 now = rdtsc(), deadline = NEVER;
+
+  if(q->n > 0)
+    deadline = q->heap[0]->expires;
+  if(q->ticking && q->tickdue < deadline)
+    deadline = q->tickdue;
+  q->deadline = deadline;
+  if(deadline == NEVER)
+    lapiconeshot(0);
+  else
+    lapiconeshot(tsc2lapic(deadline > now ? deadline - now : 0));
+}
+
+static void
+siftup(struct timerq *q, int i)
+{
+  struct timer *t = q->heap[i];
+
+  while(i > 0 && q->heap[(i - 1) / 2]->expires > t->expires){
+    q->heap[i] = q->heap[(i - 1) / 2];
+    q->heap[i]->slot = i;
+    i = (i - 1) / 2;
+  }
+  q->heap[i] = t;
+  t->slot = i;
+}
+
+static void
+siftdown(struct timerq *q, int i)
+{
+  struct timer *t = q->heap[i];
+  int c;
+
+  while((c = 2 * i + 1) < q->n){
+    if(c + 1 < q->n && q->heap[c + 1]->expires < q->heap[c]->expires)
+      c++;
+    if(q->heap[c]->expires >= t->expires)
+      break;
+    q->heap[i] = q->heap[c];
+    q->heap[i]->slot = i;
+    i = c;
+  }
+  q->heap[i] = t;
+  t->slot = i;
+}
+
+static void
+timerunlink(struct timerq *q, struct timer *t)
+{
+  struct timer *last = q->heap[--q->n];
+  int i = t->slot;
+
+  t->q = 0;
+  if(i < q->n){
+    q->heap[i] = last;
+    last->slot = i;
+    siftdown(q, i);
+    siftup(q, last->slot);
+  }
+}
+
+// Queue t on this CPU. t->expires and t->fn must be set.
+void
+timeradd(struct timer *t)
+{
+  struct timerq *q;
+
+  pushcli();
+  q = &timerqs[cpuid()];
+  acquire(&q->lock);
+  if(q->n == NTIMER)
+    panic("timeradd");
+  t->q = q;
+  q->heap[q->n] = t;
+  siftup(q, q->n++);
+  if(t->expires < q->deadline)
+    timerarm(q);
+  release(&q->lock);
+  popcli();
+}
+
+// Cancel t if it has not fired yet.
+void
+timerdel(struct timer *t)
+{
+  struct timerq *q = t->q;
+
+  if(q == 0)
+    return;
+  acquire(&q->lock);
+  if(t->q == q)
+    timerunlink(q, t);
+  release(&q->lock);
+}
+
+// Timer interrupt: run the timers that are due and re-arm. Returns
+// whether the running process's tick came due, so it should yield.
+int
+timerintr(void)
+{
+  struct timerq *q = &timerqs[cpuid()];
+  struct timer *t;
+  uint64 now;
+  int tick;
+
+  tickupdate();
+  acquire(&q->lock);
+  while(q->n > 0 && (t = q->heap[0])->expires <= rdtsc()){
+    timerunlink(q, t);
+    t->fn(t);
+  }
+  now = rdtsc();
+  tick = q->ticking && now >= q->tickdue;
+  if(tick)
+    q->tickdue = now + tickcycles;
+  q->ticking = mycpu()->proc != 0;
+  timerarm(q);
+  release(&q->lock);
+  return tick;
+}
+
+// The scheduler is about to run a process on this CPU:
+// make sure a tick comes to preempt it.
+void
+timertick(void)
+{
+  struct timerq *q;
+
+  pushcli();
+  q = &timerqs[cpuid()];
+  acquire(&q->lock);
+  if(!q->ticking){
+    q->ticking = 1;
+    q->tickdue = rdtsc() + tickcycles;
+    timerarm(q);
+  }
+  release(&q->lock);
+  popcli();
+}
+
+static void
+timerwake(struct timer *t)
+{
+  wakeup(t);
+}
+
+// Sleep until the TSC reaches deadline.
+// Return -1 if the process was killed first.
+int
+timersleep(uint64 deadline)
+{
+  struct timer t;
+  struct timerq *q;
+  int r = 0;
+
+  t.expires = deadline;
+  t.fn = timerwake;
+  timeradd(&t);
+  // The timer fires with q->lock held, and it stays on q until then.
+  q = t.q;
+  if(q == 0)
+    return 0;
+  acquire(&q->lock);
+  while(t.q){
+    if(myproc()->killed){
+      timerunlink(q, &t);
+      r = -1;
+      break;
+    }
+    sleep(&t, &q->lock);
+  }
+  release(&q->lock);
+  return r;
+}
+
+int
+ticksleep(uint n)
+{
+  return timersleep(rdtsc() + (uint64)n * tickcycles);
+}
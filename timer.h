@@ -0,0 +1,14 @@
+#ifndef XV6_PUBLIC_TIMER_H
+#define XV6_PUBLIC_TIMER_H
+
+// A one-shot kernel timer. fn runs from the timer interrupt of the CPU
+// the timer was added on, with that CPU's timer queue locked.
+struct timer {
+  uint64 expires;              // TSC deadline
+  void (*fn)(struct timer*);
+  void *arg;
+  struct timerq *q;            // queue holding the timer, 0 once fired
+  int slot;                    // index in q's heap
+};
+
+#endif //XV6_PUBLIC_TIMER_H
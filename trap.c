@@ -47,28 +47,20 @@ trap(struct trapframe *tf)
   }
 
   int pgflt_success = FALSE;
+  int tick = FALSE;
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpuid() == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-
-
-    }
-//    else if(cpuid() == 1){
-//      acquire(&tickslock);
-//
-//      if (ticks !=0 && (ticks % SWAP_INTERVAL) == 0){
-//        swap();
-//      }
-//      release(&tickslock);
-//
-//    }
+    tick = timerintr();
     lapiceoi();
-
-      break;
+    break;
+  case T_IRQ0 + IRQ_WAKE:
+  case T_IRQ0 + IRQ_RESCHED:
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_TLB:
+    tlbflushed();
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_IDE:
     ideintr();
     lapiceoi();
@@ -157,10 +149,11 @@ ERROR_GOTO:
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU on clock tick, but not for a timer
+  // that merely expired (a nanosleep waking up) before its tick.
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&
-      (tf->trapno == T_IRQ0+IRQ_TIMER || pgflt_success))
+      (tick || tf->trapno == T_IRQ0+IRQ_RESCHED || pgflt_success))
     yield();
 
   // Check if the process has been killed since we yielded
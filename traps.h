@@ -34,6 +34,9 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_WAKE        20      // IPI that gets an idle CPU out of hlt
+#define IRQ_RESCHED     21      // IPI that makes a CPU yield its process
+#define IRQ_TLB         22      // IPI that makes a CPU flush its TLB
 #define IRQ_SPURIOUS    31
 #define IRQ_SWAP        3
 
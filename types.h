@@ -2,6 +2,7 @@ typedef unsigned int   uint;
 typedef unsigned short ushort;
 typedef unsigned char  uchar;
 typedef uint pde_t;
+typedef unsigned long long uint64;
 typedef char BOOL;
 #ifndef __off_t_defined
 typedef int off_t;
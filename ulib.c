@@ -3,6 +3,9 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "param.h"
+#include "futex.h"
+#include "date.h"
 
 char*
 strcpy(char *s, const char *t)
@@ -104,3 +107,115 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Locks that only enter the kernel when contended (Drepper,
+// "Futexes Are Tricky"): state 2 tells the holder to wake someone.
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  uint c;
+
+  if((c = cmpxchg(&m->state, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = xchg(&m->state, 2);
+  while(c != 0){
+    futex(&m->state, FUTEX_WAIT, 2);
+    c = xchg(&m->state, 2);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(xchg(&m->state, 0) == 2)
+    futex(&m->state, FUTEX_WAKE, 1);
+}
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+// A signal after m is dropped changes seq, so FUTEX_WAIT
+// returns at once instead of missing it.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  uint seq = c->seq;
+
+  mutex_unlock(m);
+  futex(&c->seq, FUTEX_WAIT, seq);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  xadd(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  xadd(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, NPROC);
+}
+
+// Milliseconds from a to b, for the benchmarks.
+uint
+elapsedms(struct timespec *a, struct timespec *b)
+{
+  return (b->tv_sec - a->tv_sec) * 1000 + b->tv_nsec / 1000000 - a->tv_nsec / 1000000;
+}
+
+// Microseconds from a to b.
+uint
+elapsedus(struct timespec *a, struct timespec *b)
+{
+  return (b->tv_sec - a->tv_sec) * 1000000 + b->tv_nsec / 1000 - a->tv_nsec / 1000;
+}
+
+// cycles / n, for the benchmarks, without the 64-bit division
+// user programs cannot link.
+uint
+cyclesper(uint64 cycles, int n)
+{
+  if(cycles >> 32)
+    return ((uint)(cycles >> 10) / n) << 10;
+  return (uint)cycles / n;
+}
+
+// Name the benchmark file "<prefix><p>", or "<prefix><p>.<n>" if
+// n >= 0, in s.
+void
+benchname(char *s, const char *prefix, int p, int n)
+{
+  char d[12];
+  int i, k;
+
+  strcpy(s, prefix);
+  s += strlen(s);
+  for(k = 0; k < 2; k++){
+    i = 0;
+    do {
+      d[i++] = '0' + p % 10;
+      p /= 10;
+    } while(p);
+    while(i > 0)
+      *s++ = d[--i];
+    if(k == 1 || n < 0)
+      break;
+    *s++ = '.';
+    p = n;
+  }
+  *s = 0;
+}
@@ -2,6 +2,20 @@ struct stat;
 struct rtcdate;
 struct procinfo;
 struct cpuinfo;
+struct ksmstat;
+struct bcachestat;
+struct wssinfo;
+struct timespec;
+struct schedhist;
+
+// Futex-based locks for the threads of one process (ulib.c).
+struct mutex {
+  volatile uint state;  // 0 free, 1 held, 2 held with waiters
+};
+
+struct cond {
+  volatile uint seq;    // bumped by every signal
+};
 
 #define STDIN  0
 #define STDOUT 1
@@ -40,6 +54,33 @@ int date(struct rtcdate *);
 int toggleLogging(void);
 int state(struct procinfo* pi_arr[], struct cpuinfo* cpui_arr[]);
 int swap(void);
+int madvise(void*, uint, int);
+int mlock(void*, uint);
+int munlock(void*, uint);
+int mlockall(int);
+int munlockall(void);
+int ksmstat(struct ksmstat*);
+int wss(int, struct wssinfo*);
+int idleinterval(int);
+int yield(void);
+int setpriority(int, int);
+int getpriority(int, int*);
+int nice(int);
+int setclass(int, int);
+int nanosleep(struct timespec*);
+int monotime(struct timespec*);
+int sched_setaffinity(int, uint);
+int sched_getaffinity(int, uint*);
+int clone(void (*)(void*), void*, void*);
+int join(void**);
+int futex(volatile uint*, int, int);
+int schedstat(int, struct schedhist*);
+int setgang(int, int);
+int bcachestat(struct bcachestat*);
+int fadvise(int, int);
+int sync(void);
+int fsync(int);
+int fruns(int);
 
 
 // ulib.c
@@ -59,6 +100,21 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+uint elapsedms(struct timespec*, struct timespec*);
+uint elapsedus(struct timespec*, struct timespec*);
+void benchname(char*, const char*, int, int);
+uint cyclesper(uint64, int);
+
+// uthread.c
+int thread_create(void (*)(void*), void*);
+int thread_join(void);
 #ifdef __cplusplus
 }
 #endif
@@ -7,6 +7,8 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "mmu.h"
+#include "mman.h"
 
 char buf[8192];
 char name[3];
@@ -184,22 +186,27 @@ writetest(void)
   printf(stdout, "small file test ok\n");
 }
 
+// A file reaching into the double-indirect blocks
+// when block mapped, about 6MB.
+#define BIGBLOCKS (NDIRECT + NINDIRECT + NINDIRECT/2)
+
+// mode is O_BLOCKMAP or 0 for extents.
 void
-writetest1(void)
+writetest1(int mode)
 {
   int i, fd, n;
 
   printf(stdout, "big files test\n");
 
-  fd = open("big", O_CREATE|O_RDWR);
+  fd = open("big", O_CREATE|O_RDWR|mode);
   if(fd < 0){
     printf(stdout, "error: creat big failed!\n");
     exit();
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGBLOCKS; i++){
     ((int*)buf)[0] = i;
-    if(write(fd, buf, 512) != 512){
+    if(write(fd, buf, BSIZE) != BSIZE){
       printf(stdout, "error: write big file failed\n", i);
       exit();
     }
@@ -215,14 +222,14 @@ writetest1(void)
 
   n = 0;
   for(;;){
-    i = read(fd, buf, 512);
+    i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != BIGBLOCKS){
         printf(stdout, "read only %d blocks from big", n);
         exit();
       }
       break;
-    } else if(i != 512){
+    } else if(i != BSIZE){
       printf(stdout, "read failed %d\n", i);
       exit();
     }
@@ -1144,6 +1151,61 @@ bigwrite(void)
   printf(1, "bigwrite ok\n");
 }
 
+// write() from a buffer that was swapped out: swapping it back in
+// writes the swap file from inside write()'s own log transaction.
+void
+swapwrite(void)
+{
+  enum { NPAGES = 8 };
+  char *mem, *p;
+  int fd, i;
+
+  printf(1, "swapwrite test\n");
+
+  mem = sbrk(NPAGES * PGSIZE);
+  if(mem == (char*)-1){
+    printf(1, "swapwrite: sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < NPAGES * PGSIZE; i++)
+    mem[i] = i % 251;
+  // SEQUENTIAL pages go on the first swap(), and come back
+  // several at a time.
+  madvise(mem, NPAGES * PGSIZE, MADV_SEQUENTIAL);
+  swap();
+
+  unlink("swapwrite");
+  fd = open("swapwrite", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf(1, "swapwrite: cannot create\n");
+    exit();
+  }
+  if(write(fd, mem, NPAGES * PGSIZE) != NPAGES * PGSIZE){
+    printf(1, "swapwrite: write failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("swapwrite", O_RDONLY);
+  for(p = mem; p < mem + NPAGES * PGSIZE; p += sizeof(buf)){
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(1, "swapwrite: read failed\n");
+      exit();
+    }
+    for(i = 0; i < sizeof(buf); i++){
+      if(buf[i] != p[i]){
+        printf(1, "swapwrite: wrong data\n");
+        exit();
+      }
+    }
+  }
+  close(fd);
+  unlink("swapwrite");
+  sbrk(-NPAGES * PGSIZE);
+
+  printf(1, "swapwrite ok\n");
+}
+
 void
 bigfile(void)
 {
@@ -1768,6 +1830,7 @@ main(int argc, char *argv[])
 
   bigargtest();
   bigwrite();
+  swapwrite();
   bigargtest();
   bsstest();
   sbrktest();
@@ -1775,7 +1838,8 @@ main(int argc, char *argv[])
 
   opentest();
   writetest();
-  writetest1();
+  writetest1(O_BLOCKMAP);
+  writetest1(0);
   createtest();
 
   openiputtest();
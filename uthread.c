@@ -0,0 +1,51 @@
+#include "types.h"
+#include "user.h"
+
+// Threads run on a one-page stack from malloc(), which is not thread
+// safe: create and join them from one thread only.
+#define TSTACK 4096  // clone() stacks are one page
+
+struct tstart {
+  void (*fn)(void*);
+  void *arg;
+};
+
+// Threads start here, so that returning from fn ends the thread.
+static void
+thread_start(void *a)
+{
+  struct tstart *t = a;
+
+  t->fn(t->arg);
+  exit();
+}
+
+// Run fn(arg) in a new thread; returns its pid.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  char *stack;
+  struct tstart *t;
+  int pid;
+
+  if((stack = malloc(TSTACK + sizeof(*t))) == 0)
+    return -1;
+  t = (struct tstart*)(stack + TSTACK);  // above the stack's top
+  t->fn = fn;
+  t->arg = arg;
+  if((pid = clone(thread_start, t, stack)) < 0)
+    free(stack);
+  return pid;
+}
+
+// Wait for a thread to finish and free its stack; returns its pid.
+int
+thread_join(void)
+{
+  void *stack;
+  int pid;
+
+  if((pid = join(&stack)) >= 0)
+    free(stack);
+  return pid;
+}
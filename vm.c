@@ -13,6 +13,7 @@
 #include "debug.h"
 #include "swap.h"
 #include "iterator.h"
+#include "mman.h"
 
 extern struct {
   struct spinlock lock;
@@ -29,6 +30,7 @@ pde_t *kpgdir;  // for use in scheduler()
 int copy_on_write(void *va, pte_t *pte, pde_t *pgdir);
 
 int swaprestore(void *va, pte_t *pte, pde_t *pgdir);
+static void swapreadahead(struct proc *p, uint va, int n);
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 
@@ -51,7 +53,7 @@ seginit(void) {
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, BOOL alloc) {
   pde_t *pde;
   pte_t *pgtab;
@@ -165,12 +167,23 @@ setupkvm(void) {
   return pgdir;
 }
 
+// Threads made by clone() share one page table and can fault on the
+// same page, or grow the heap, at the same time. vmlocks[] let one of
+// them change the page table while the others wait; they are only
+// taken for address spaces with more than one user, and hashed by
+// pgdir so that unrelated processes rarely wait on each other.
+static struct sleeplock vmlocks[NVMLOCK];
+
 // Allocate one page table for the machine for the kernel address
 // space for scheduler processes.
 void
 kvmalloc(void) {
+  int i;
+
   kpgdir = setupkvm();
   switchkvm();
+  for (i = 0; i < NVMLOCK; i++)
+    initsleeplock(&vmlocks[i], "vm");
 }
 
 // Switch h/w page table register to the kernel-only page table,
@@ -316,6 +329,42 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz) {
   return newsz;
 }
 
+// Unmap the resident pages of [start, end) and free them, for an
+// address space other threads may be running in: a batch of pages
+// is freed only after tlbshootdown() made sure no CPU still has them
+// in its TLB. Swapped-out pages are left to deallocuvm().
+#define UNMAPBATCH 32
+void
+unmapuvm(pde_t *pgdir, uint start, uint end) {
+  char *batch[UNMAPBATCH];
+  pte_t *pte;
+  uint a;
+  int n = 0, i;
+
+  for (a = PGROUNDUP(start); a < end; a += PGSIZE) {
+    pte = walkpgdir(pgdir, (char *) a, FALSE);
+    if (pte == NULL) {
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if ((*pte & PTE_P) == 0)
+      continue;
+    batch[n++] = P2V(PTE_ADDR(*pte));
+    *pte = 0;
+    if (n == UNMAPBATCH) {
+      tlbshootdown(pgdir);
+      for (i = 0; i < n; i++)
+        kfree(batch[i]);
+      n = 0;
+    }
+  }
+  if (n > 0) {
+    tlbshootdown(pgdir);
+    for (i = 0; i < n; i++)
+      kfree(batch[i]);
+  }
+}
+
 // Free a page table and all the physical memory pages
 // in the user part.
 void
@@ -372,7 +421,7 @@ copyuvm(pde_t *pgdir, uint sz) {
 //    if ((*pte & PTE_W)) // only pages one can write to must be marked PTE_C
     *pte = (*pte & ~PTE_W) | PTE_C; // change parent's and child's flags
     pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);// & ~PTE_W) | PTE_C; // copy-on-write child
+    flags = PTE_FLAGS(*pte) & ~PTE_L; // memory locks are not inherited
 
     // TODO update swapmap
     if (mappages(d, (void *) i, PGSIZE, pa, flags) < 0) {
@@ -465,6 +514,19 @@ copyout(pde_t *pgdir, uint va, void *p, uint len) {
 //#include "file.h"
 extern char end[];
 
+// Test and clear whether the page behind a present pte was referenced
+// since the last call. kidled clears PTE_A to sample working sets and
+// leaves page_data_t.young set, so swap() still sees those accesses.
+BOOL
+pte_young(pte_t *pte) {
+  page_data_t *pd = get_pd(PTE_ADDR(*pte));
+  BOOL young = (*pte & PTE_A) || pd->young;
+
+  *pte &= ~PTE_A;
+  pd->young = FALSE;
+  return young;
+}
+
 int swap() {
   struct proc *p;
 
@@ -488,13 +550,13 @@ int swap() {
 
       pte_t *pte = walkpgdir(p->pgdir, (void *) a, 0); //returns number of allocated pde entries
 
-      if (pte == NULL) {
+      if (pte == NULL || (*pte & PTE_L)) {
         continue;
       }
 
       if ((*pte & PTE_P) && !(*pte & PTE_C)) {
-        if ((*pte & PTE_A)) {
-          *pte &= ~PTE_A;
+        // pages behind a sequential stream do not get a second chance
+        if (madvice_of(p, a) != MADV_SEQUENTIAL && pte_young(pte)) {
           ++accessed_page_num;
         } else {
           char *va = (P2V(PTE_ADDR(*pte)));
@@ -507,6 +569,7 @@ int swap() {
 #endif
 
           swapwrite_file(va, (void *) a, pte);
+          p->nswapout++;
           {//          swapwrite(va, (void *) a);
 //          kfree(va); //TODO}
           }
@@ -556,6 +619,9 @@ int swaprestore(void *va, pte_t *pte, pde_t *pgdir) {
 //    return -1;
 //  }
   swapread_file(va, pte);
+  // every caller restores pages of the current process
+  if (myproc() != NULL && myproc()->pgdir == pgdir)
+    myproc()->nswapin++;
 #ifdef DEBUG_SWAPRESTORE
   cprintf("swaprestore: post: 0x%x\n", PTE_ADDR(*pte));
 #endif
@@ -568,17 +634,23 @@ int lazyalloc(void *va, struct proc *p) {
 
 
   char *mem;
+  int perm = PTE_W | PTE_U;
+
   mem = kalloc();
   if (mem == 0) {
     cprintf("lazyalloc out of memory\n");
     return -1;
   }
   memset(mem, 0, PGSIZE);
-  if (mappages(p->pgdir, (char *) va, PGSIZE, V2P(mem), PTE_W | PTE_U) < 0) {
+  if ((p->mlockflags & MCL_FUTURE) && p->nlocked < MLOCKLIMIT)
+    perm |= PTE_L;
+  if (mappages(p->pgdir, (char *) va, PGSIZE, V2P(mem), perm) < 0) {
     cprintf("lazyalloc out of memory (2)\n");
     kfree(mem);
     return -1;
   }
+  if (perm & PTE_L)
+    p->nlocked++;
   return 0;
 }
 
@@ -596,6 +668,7 @@ int copy_on_write(void *va, pte_t *pte, pde_t *pgdir) {
 #endif
     *pte &= ~PTE_C;
     *pte |= PTE_W;
+    get_pd(pa_to_free)->ksm = FALSE; // a merged page that is private again
 #ifdef DEBUG_COW
     cprintf("post: 0b%b\n", PTE_FLAGS(*pte));
 #endif
@@ -608,7 +681,7 @@ int copy_on_write(void *va, pte_t *pte, pde_t *pgdir) {
   }
   memmove(mem, P2V(pa_to_free), PGSIZE);
 
-  if (mappages(pgdir, (char *) va, PGSIZE, V2P(mem), PTE_W | PTE_U) < 0) {
+  if (mappages(pgdir, (char *) va, PGSIZE, V2P(mem), PTE_W | PTE_U | (*pte & PTE_L)) < 0) {
     cprintf("copy_on_write out of memory (2)\n");
     kfree(mem);
     return -1;
@@ -618,7 +691,56 @@ int copy_on_write(void *va, pte_t *pte, pde_t *pgdir) {
   return 0;
 };
 
+// Lock p's page table against the other threads sharing it.
+// Return the lock to pass to vmend(), 0 if p has it to itself.
+struct sleeplock *vmbegin(struct proc *p) {
+  struct sleeplock *lk;
+
+  if (!vmshared(p))
+    return 0;
+  lk = &vmlocks[((uint) p->pgdir / PGSIZE) % NVMLOCK];
+  acquiresleep(lk);
+  return lk;
+}
+
+void vmend(struct sleeplock *lk) {
+  if (lk)
+    releasesleep(lk);
+}
+
+static int pagefault(uint addr, uint err);
+
 int handle_pagefault(uint addr, uint err) {
+  struct proc *p = myproc();
+  struct sleeplock *locked;
+  pte_t *pte;
+  int result;
+
+  if (!(locked = vmbegin(p)))
+    return pagefault(addr, err);
+  // another thread may have fixed the page while we waited
+  if (addr < KERNBASE && (pte = walkpgdir(p->pgdir, (void *) addr, FALSE)) != NULL &&
+      (*pte & PTE_P) && (!(err & PTE_W) || (*pte & PTE_W)))
+    result = 0;
+  else
+    result = pagefault(addr, err);
+  vmend(locked);
+  return result;
+}
+
+// Make the user page at va of the current process present and
+// writable, as a write fault would.
+int faultin(uint va) {
+  pte_t *pte = walkpgdir(myproc()->pgdir, (void *) va, FALSE);
+
+  if (pte != NULL && (*pte & PTE_P) && !(*pte & PTE_U))
+    return -1;  // the stack guard page
+  if (pte != NULL && (*pte & PTE_P) && (*pte & PTE_W))
+    return 0;
+  return handle_pagefault(va, PTE_P | PTE_W | PTE_U);
+}
+
+static int pagefault(uint addr, uint err) {
   struct proc *p = myproc();
   uint raw_va = addr;
   void *va = (void *) PGROUNDDOWN(raw_va);
@@ -642,6 +764,7 @@ int handle_pagefault(uint addr, uint err) {
 #ifdef DEBUG_T_PGFLT
     cprintf("trying to lazyalloc");
 #endif
+    p->minflt++;
     return lazyalloc(va, p);
   }
   int result = -1;
@@ -650,12 +773,27 @@ int handle_pagefault(uint addr, uint err) {
     cprintf("trying to restore the swapped page\n");
 #endif
     result = MAX(result, swaprestore(va, pte, p->pgdir));
+    if (result == 0) {
+      p->majflt++;
+      switch (madvice_of(p, (uint) va)) {
+        case MADV_SEQUENTIAL:
+          swapreadahead(p, (uint) va, SWAPREADAHEAD);
+          break;
+        case MADV_RANDOM:
+          break;
+        default:
+          swapreadahead(p, (uint) va, SWAPCLUSTER);
+      }
+    }
   }
   if ((*pte & PTE_C) && (err & PTE_W)) { // ensure that it was just write error
 #ifdef DEBUG_T_PGFLT
     cprintf("trying to copy_on_write\n");
 #endif
-    result = MAX(result, copy_on_write(va, pte, p->pgdir));
+    int cow = copy_on_write(va, pte, p->pgdir);
+    if (cow == 0)
+      p->cowflt++;
+    result = MAX(result, cow);
 //    if(result == 0) {
 //      dec_ref_pa(mappages(pte))
 //    }
@@ -664,6 +802,7 @@ int handle_pagefault(uint addr, uint err) {
 #ifdef DEBUG_T_PGFLT
     cprintf("trying to lazyalloc (2)\n");
 #endif
+    p->minflt++;
     return lazyalloc(va, p);
   }
   //flush tlb because PTEs change
@@ -672,6 +811,251 @@ int handle_pagefault(uint addr, uint err) {
 //  return 0;
 }
 
+// Restore up to n swapped-out pages that follow va, so that a
+// sequential reader takes one fault per n + 1 pages instead of one per page.
+static void
+swapreadahead(struct proc *p, uint va, int n) {
+  pte_t *pte;
+  uint a;
+
+  for (a = va + PGSIZE; a < va + (n + 1) * PGSIZE && a < p->sz; a += PGSIZE) {
+    if ((pte = walkpgdir(p->pgdir, (void *) a, FALSE)) == NULL)
+      break;
+    if (!(*pte & PTE_S))
+      continue;
+    if (swaprestore((void *) a, pte, p->pgdir) < 0)
+      break;
+  }
+}
+
+// Return the madvise() hint that covers user address va.
+int
+madvice_of(struct proc *p, uint va) {
+  struct vmadvice *a;
+
+  for (a = p->advice; a < &p->advice[NMADVISE]; a++)
+    if (va >= a->start && va < a->end)
+      return a->advice;
+  return MADV_NORMAL;
+}
+
+// Tag [start, end) with advice, trimming or splitting older
+// regions that overlap it. MADV_NORMAL just clears the range.
+static int
+setadvice(struct proc *p, uint start, uint end, int advice) {
+  struct vmadvice *a, *b;
+
+  for (a = p->advice; a < &p->advice[NMADVISE]; a++) {
+    if (a->start == a->end || a->end <= start || a->start >= end)
+      continue;
+    if (a->start < start && a->end > end) {
+      for (b = p->advice; b < &p->advice[NMADVISE]; b++)
+        if (b->start == b->end)
+          break;
+      if (b == &p->advice[NMADVISE])
+        return -1;
+      b->start = end;
+      b->end = a->end;
+      b->advice = a->advice;
+      a->end = start;
+    } else if (a->start < start)
+      a->end = start;
+    else if (a->end > end)
+      a->start = end;
+    else
+      a->start = a->end = 0;
+  }
+  if (advice == MADV_NORMAL)
+    return 0;
+  for (a = p->advice; a < &p->advice[NMADVISE]; a++) {
+    if (a->start == a->end) {
+      a->start = start;
+      a->end = end;
+      a->advice = advice;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Fault in every page of [start, end) that is not resident yet.
+static int
+prefault(struct proc *p, uint start, uint end) {
+  pte_t *pte;
+  uint a;
+
+  for (a = start; a < end; a += PGSIZE) {
+    pte = walkpgdir(p->pgdir, (void *) a, FALSE);
+    if (pte == NULL || !(*pte & (PTE_P | PTE_S))) {
+      if (lazyalloc((void *) a, p) < 0)
+        return -1;
+    } else if (*pte & PTE_S) {
+      if (swaprestore((void *) a, pte, p->pgdir) < 0)
+        return -1;
+    }
+  }
+  return 0;
+}
+
+// Is any page of [start, end) pinned by mlock(), or a stack guard
+// page (present but cleared of PTE_U by clearpteu())?
+static int
+haspinned(pde_t *pgdir, uint start, uint end) {
+  pte_t *pte;
+  uint a;
+
+  for (a = start; a < end; a += PGSIZE) {
+    if ((pte = walkpgdir(pgdir, (void *) a, FALSE)) == NULL)
+      continue;
+    if ((*pte & PTE_L) || ((*pte & PTE_P) && !(*pte & PTE_U)))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+// Apply an madvise() hint to the user range [addr, addr+len).
+// addr must be page aligned; the range is clipped to p->sz.
+int
+madvise(struct proc *p, uint addr, uint len, int advice) {
+  uint end;
+
+  if (addr % PGSIZE || addr + len < addr)
+    return -1;
+  end = PGROUNDUP(addr + len);
+  if (end > p->sz)
+    end = PGROUNDUP(p->sz);
+  if (addr >= end)
+    return -1;
+
+  switch (advice) {
+    case MADV_NORMAL:
+    case MADV_RANDOM:
+    case MADV_SEQUENTIAL:
+      return setadvice(p, addr, end, advice);
+    case MADV_WILLNEED:
+      return prefault(p, addr, end);
+    case MADV_DONTNEED:
+      if (haspinned(p->pgdir, addr, end))
+        return -1;
+      unmapuvm(p->pgdir, addr, end);
+      // swapfree_file() drops ptable.lock around the swapfile write,
+      // the same way it does when freevm() is called from wait().
+      acquire(&ptable.lock);
+      deallocuvm(p->pgdir, end, addr);
+      release(&ptable.lock);
+      flush_tlb();
+      return 0;
+  }
+  return -1;
+}
+
+// Count the resident, swapped-out and locked pages below sz.
+void
+countuvm(pde_t *pgdir, uint sz, uint *resident, uint *swapped, uint *locked) {
+  pte_t *pte;
+  uint a;
+
+  *resident = *swapped = *locked = 0;
+  for (a = 0; a < sz; a += PGSIZE) {
+    if ((pte = walkpgdir(pgdir, (void *) a, FALSE)) == NULL) {
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if (*pte & PTE_P)
+      (*resident)++;
+    else if (*pte & PTE_S)
+      (*swapped)++;
+    if (*pte & PTE_L)
+      (*locked)++;
+  }
+}
+
+// Recount p->nlocked after pages were locked, unlocked or unmapped.
+void
+mlocksync(struct proc *p) {
+  uint resident, swapped;
+
+  countuvm(p->pgdir, p->sz, &resident, &swapped, &p->nlocked);
+}
+
+// Set or clear PTE_L on every mapped page of [start, end).
+static void
+setlocked(pde_t *pgdir, uint start, uint end, int lock) {
+  pte_t *pte;
+  uint a;
+
+  for (a = start; a < end; a += PGSIZE) {
+    if ((pte = walkpgdir(pgdir, (void *) a, FALSE)) == NULL || !(*pte & PTE_P))
+      continue;
+    if (lock)
+      *pte |= PTE_L;
+    else
+      *pte &= ~PTE_L;
+  }
+}
+
+// Pin the pages of [addr, addr+len) in memory: fault them in and mark
+// them PTE_L so that swap() passes over them. Fails if the process
+// would end up with more than MLOCKLIMIT locked pages.
+int
+mlock(struct proc *p, uint addr, uint len) {
+  uint start, end, a, n;
+  pte_t *pte;
+
+  start = PGROUNDDOWN(addr);
+  end = PGROUNDUP(addr + len);
+  if (addr + len < addr || end > PGROUNDUP(p->sz))
+    return -1;
+
+  n = 0;
+  for (a = start; a < end; a += PGSIZE) {
+    pte = walkpgdir(p->pgdir, (void *) a, FALSE);
+    if (pte == NULL || !(*pte & PTE_L))
+      n++;
+  }
+  if (p->nlocked + n > MLOCKLIMIT)
+    return -1;
+
+  if (prefault(p, start, end) < 0) {
+    mlocksync(p);
+    return -1;
+  }
+  setlocked(p->pgdir, start, end, TRUE);
+  mlocksync(p);
+  return 0;
+}
+
+int
+munlock(struct proc *p, uint addr, uint len) {
+  uint end;
+
+  end = PGROUNDUP(addr + len);
+  if (addr + len < addr || end > PGROUNDUP(p->sz))
+    return -1;
+  setlocked(p->pgdir, PGROUNDDOWN(addr), end, FALSE);
+  mlocksync(p);
+  return 0;
+}
+
+// MCL_CURRENT locks everything mapped now, MCL_FUTURE makes lazyalloc()
+// lock every page it maps from here on, up to MLOCKLIMIT.
+int
+mlockall(struct proc *p, int flags) {
+  if (flags == 0 || (flags & ~(MCL_CURRENT | MCL_FUTURE)))
+    return -1;
+  if ((flags & MCL_CURRENT) && mlock(p, 0, p->sz) < 0)
+    return -1;
+  if (flags & MCL_FUTURE)
+    p->mlockflags |= MCL_FUTURE;
+  return 0;
+}
+
+int
+munlockall(struct proc *p) {
+  p->mlockflags = 0;
+  return munlock(p, 0, p->sz);
+}
+
 inline void
 flush_tlb(void) {
   lcr3(V2P(myproc()->pgdir));
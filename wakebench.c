@@ -0,0 +1,69 @@
+//
+// Sleep/wakeup cost with a full process table: pipe ping-pong round
+// trips and sleep(1) wakeups, while most slots hold sleeping processes.
+// usage: wakebench [nsleepers] [roundtrips] [sleeps]
+//
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "x86.h"
+
+int main(int argc, char **argv) {
+  int nsleepers = argc > 1 ? atoi(argv[1]) : NPROC - 8;
+  int rounds = argc > 2 ? atoi(argv[2]) : 10000;
+  int sleeps = argc > 3 ? atoi(argv[3]) : 100;
+  int idle[2], ping[2], pong[2];
+  int i, n, t0, t1;
+  uint64 c0, c1;
+  char c = 0;
+
+  // Sleepers block reading a pipe nobody writes to.
+  pipe(idle);
+  for (n = 0; n < nsleepers; ++n) {
+    int pid = fork();
+    if (pid < 0)
+      break;
+    if (pid == 0) {
+      close(idle[1]);
+      read(idle[0], &c, 1);
+      exit();
+    }
+  }
+  close(idle[0]);
+  printf(STDOUT, "wakebench: %d sleeping processes\n", n);
+
+  pipe(ping);
+  pipe(pong);
+  if (fork() == 0) {
+    for (i = 0; i < rounds; ++i) {
+      read(ping[0], &c, 1);
+      write(pong[1], &c, 1);
+    }
+    exit();
+  }
+  t0 = uptime();
+  c0 = rdtsc();
+  for (i = 0; i < rounds; ++i) {
+    write(ping[1], &c, 1);
+    read(pong[0], &c, 1);
+  }
+  c1 = rdtsc();
+  t1 = uptime();
+  wait();
+  printf(STDOUT, "pipe ping-pong: %d round trips in %d ticks, %u cycles each\n",
+         rounds, t1 - t0, cyclesper(c1 - c0, rounds));
+
+  t0 = uptime();
+  c0 = rdtsc();
+  for (i = 0; i < sleeps; ++i)
+    sleep(1);
+  c1 = rdtsc();
+  t1 = uptime();
+  printf(STDOUT, "sleep(1): %d sleeps in %d ticks, %u cycles each\n",
+         sleeps, t1 - t0, cyclesper(c1 - c0, sleeps));
+
+  close(idle[1]);
+  for (i = 0; i < n; ++i)
+    wait();
+  exit();
+}
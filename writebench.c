@@ -0,0 +1,68 @@
+//
+// Many small appends, left to logd to commit and with fsync() after
+// every write, which waits for each commit the way end_op() used to.
+// Reports writes per second and disk blocks written, sync() included.
+// usage: writebench [writes] [size]
+//
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "date.h"
+#include "bcache.h"
+
+#define FILE "writebench.tmp"
+
+static char buf[512];
+
+// Append n writes of size bytes, calling fsync() after each if eager.
+static void
+run(char *name, int n, int size, int eager) {
+  struct bcachestat before, after;
+  struct timespec t0, t1;
+  uint t, writes;
+  int fd, i;
+
+  sync();
+  bcachestat(&before);
+  monotime(&t0);
+  if ((fd = open(FILE, O_CREATE | O_RDWR)) < 0) {
+    printf(STDERR, "writebench: cannot create %s\n", FILE);
+    exit();
+  }
+  for (i = 0; i < n; ++i) {
+    if (write(fd, buf, size) != size) {
+      printf(STDERR, "writebench: write failed\n");
+      exit();
+    }
+    if (eager)
+      fsync(fd);
+  }
+  close(fd);
+  sync();
+  monotime(&t1);
+  bcachestat(&after);
+  unlink(FILE);
+
+  t = elapsedms(&t0, &t1);
+  writes = after.writes - before.writes;
+  printf(STDOUT, "%s %d writes/s, %d blocks written, %d.%d per write\n", name,
+         t ? n * 1000 / t : 0, writes, writes / n, writes * 10 / n % 10);
+}
+
+int main(int argc, char **argv) {
+  int n, size;
+
+  n = argc > 1 ? atoi(argv[1]) : 500;
+  size = argc > 2 ? atoi(argv[2]) : 32;
+  if (n < 1 || size < 1 || size > sizeof(buf)) {
+    printf(STDERR, "usage: writebench [writes] [size]\n");
+    exit();
+  }
+  memset(buf, 'w', sizeof(buf));
+
+  printf(STDOUT, "writebench: %d writes of %d bytes\n", n, size);
+  run("async:     ", n, size, 0);
+  run("fsync each:", n, size, 1);
+  exit();
+}
@@ -0,0 +1,51 @@
+//
+// Print working-set estimates from kidled.
+// usage: wss [-i ticks] [pid ...]
+//
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "stateinfo.h"
+
+static void
+print(int pid) {
+  struct wssinfo wi;
+
+  if (wss(pid, &wi) < 0) {
+    printf(STDERR, "wss: no process %d\n", pid);
+    return;
+  }
+  printf(STDOUT, "pid:%2d\tsamples:%u\trss:%9u", wi.pid, wi.samples, wi.resident);
+  for (int k = 0; k < NWSSWIN; ++k)
+    printf(STDOUT, "\twss(%ut):%9u", wi.window[k], wi.wss[k]);
+  printf(STDOUT, "\n");
+}
+
+int main(int argc, char **argv) {
+  int i = 1;
+
+  if (argc > 2 && strcmp(argv[1], "-i") == 0) {
+    int old = idleinterval(atoi(argv[2]));
+    printf(STDOUT, "sampling interval: %d -> %d ticks\n", old, idleinterval(0));
+    i = 3;
+  }
+  if (i < argc) {
+    for (; i < argc; ++i)
+      print(atoi(argv[i]));
+    exit();
+  }
+
+  struct procinfo *pi_arr = malloc(NPROC * sizeof(struct procinfo));
+  struct cpuinfo *cpui_arr = malloc(NCPU * sizeof(struct cpuinfo));
+  if (state(&pi_arr, &cpui_arr) < 0) {
+    printf(STDERR, "wss: state failed\n");
+    exit();
+  }
+  for (int j = 0; j < NPROC; ++j) {
+    if (pi_arr[j].pid == 0 && pi_arr[j].size == 0)
+      break;
+    if (pi_arr[j].size > 0)
+      print(pi_arr[j].pid);
+  }
+  exit();
+}
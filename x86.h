@@ -18,6 +18,15 @@ insl(int port, void *addr, int cnt)
                "memory", "cc");
 }
 
+static inline uint64
+rdtsc(void)
+{
+  uint64 tsc;
+
+  asm volatile("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
 static inline void
 outb(ushort port, uchar data)
 {
@@ -117,6 +126,14 @@ sti(void)
   asm volatile("sti");
 }
 
+// Enable interrupts and halt until one arrives. sti only takes
+// effect after the next instruction, so none can slip in before hlt.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -130,6 +147,30 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Store newval in *addr if it holds old; return what it held.
+static inline uint
+cmpxchg(volatile uint *addr, uint old, uint newval)
+{
+  uint result;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (result), "+m" (*addr) :
+               "r" (newval), "0" (old) :
+               "cc");
+  return result;
+}
+
+// Add inc to *addr; return the old value.
+static inline uint
+xadd(volatile uint *addr, uint inc)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (inc), "+m" (*addr) :
+               :
+               "cc");
+  return inc;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -149,6 +190,14 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline uint
+rcr3(void)
+{
+  uint val;
+  asm volatile("movl %%cr3,%0" : "=r" (val));
+  return val;
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().